@@ -0,0 +1,25 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+
+// Every allocation of the benchmark goes through these, so the runner can
+// report allocations per iteration.
+static std::atomic<uint64_t> allocations = 0;
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv) {
+    return BenchmarkMain(std::vector<std::string>(argv + 1, argv + argc),
+                         [] { return allocations.load(std::memory_order_relaxed); });
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+#include "Object.hpp"
+
+const size_t OBJECT_TYPE_COUNT = (size_t)ObjectType::ITERATOR + 1;
+
+// Allocations, bytes and live objects per object type and for enviroment
+// frames, counted while it is the CurrentAllocStats of a thread. Bytes per
+// type are the size of the objects themselves, LiveBytes also counts the
+// characters and elements they own.
+class AllocStats {
+   public:
+    struct Counts {
+        uint64_t Allocations = 0;
+        uint64_t Bytes = 0;
+        int64_t Live = 0;
+        int64_t PeakLive = 0;
+    };
+
+    AllocStats();
+
+    void Allocate(Counts& counts, size_t bytes);
+    void Free(Counts& counts, size_t bytes);
+    // Adds bytes owned by live objects, negative when they are freed.
+    void Charge(int64_t bytes);
+
+    uint64_t Allocations() const;
+    // Allocations per second since the stats were created.
+    double Rate() const;
+
+    void Report(std::ostream& out) const;
+    // The stats as a hash of type name to a hash of counts, for stats().
+    std::shared_ptr<IObject> ToHash() const;
+
+    std::array<Counts, OBJECT_TYPE_COUNT> Types;
+    Counts Envs;
+    int64_t LiveBytes = 0;
+    int64_t PeakLiveBytes = 0;
+
+   private:
+    std::chrono::steady_clock::time_point start;
+};
@@ -69,6 +69,19 @@ struct IntegerLiteral : public Expression {
     std::shared_ptr<IObject> Evaluate(std::shared_ptr<Env> env) override;
 };
 
+struct FloatLiteral : public Expression {
+    Token TheToken;
+    // Made once when parsed, as floats are immutable.
+    std::shared_ptr<FloatObj> Value;
+
+    FloatLiteral(Token t) : TheToken(t) {}
+    void ExpressionNode() override {}
+    std::string TokenLiteral() override { return TheToken.Literal; }
+
+    std::string ToString() override { return TheToken.Literal; }
+    std::shared_ptr<IObject> Evaluate(std::shared_ptr<Env> env) override;
+};
+
 struct PrefixExpression : public Expression {
     Token TheToken;
     std::string Operator;
@@ -243,6 +256,52 @@ struct BreakStatement : public Statement {
     std::shared_ptr<IObject> Evaluate(std::shared_ptr<Env> env) override;
 };
 
+struct IncludeStatement : public Statement {
+    Token TheToken;
+    std::string Path;
+    // The directory of the file the statement is in, Path is relative to it.
+    std::string BaseDir;
+    // Filled in by ModuleCache::Prefetch relative to the including file.
+    std::string ResolvedPath;
+
+    IncludeStatement(Token t) : TheToken(t) {}
+    void StatementNode() override {}
+    std::string TokenLiteral() override { return TheToken.Literal; }
+    std::string ToString() override { return TheToken.Literal + " \"" + Path + "\""; }
+    std::shared_ptr<IObject> Evaluate(std::shared_ptr<Env> env) override;
+};
+
+// Hands a value to whoever iterates the generator running it.
+struct YieldStatement : public Statement {
+    Token TheToken;
+    std::shared_ptr<Expression> Value;
+
+    YieldStatement(Token t) : TheToken(t) {}
+    void StatementNode() override {}
+    std::string TokenLiteral() override { return TheToken.Literal; }
+    std::string ToString() override { return TheToken.Literal + " " + Value->ToString() + ";"; }
+    std::shared_ptr<IObject> Evaluate(std::shared_ptr<Env> env) override;
+};
+
+// Voice blocks written one after another. They run together, each with a
+// time cursor of its own, and the statement ends when all of them have.
+struct VoiceStatement : public Statement {
+    Token TheToken;
+    std::vector<std::shared_ptr<BlockStatement>> Voices;
+
+    VoiceStatement(Token t) : TheToken(t) {}
+    void StatementNode() override {}
+    std::string TokenLiteral() override { return TheToken.Literal; }
+    std::string ToString() override {
+        std::string tmp;
+        for (const auto& voice : Voices) {
+            tmp += (tmp.empty() ? "" : " ") + TheToken.Literal + " " + voice->ToString();
+        }
+        return tmp;
+    }
+    std::shared_ptr<IObject> Evaluate(std::shared_ptr<Env> env) override;
+};
+
 struct AccessExpression : public Expression {
     Token TheToken;
 
@@ -315,6 +374,8 @@ struct FunctionLiteral : public Statement {
     std::shared_ptr<Identifier> Ident;
     std::vector<std::shared_ptr<Identifier>> Parameters;
     std::shared_ptr<BlockStatement> Body;
+    // Whether calls return a generator running Body as it is iterated.
+    bool IsGenerator = false;
 
     void StatementNode() override {}
 
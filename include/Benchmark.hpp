@@ -1,6 +1,71 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
-void Benchmark(int count=10000);
-void Run(std::string code, std::string name);
-void RunString(std::string code);
\ No newline at end of file
+struct Workload {
+    std::string Name;
+    std::string Description;
+    // Work done by one iteration, e.g. notes added or statements parsed.
+    size_t Ops;
+    // Called once before timing; returns the function that is timed.
+    std::function<std::function<void()>()> Prepare;
+};
+
+struct BenchmarkOptions {
+    std::string Filter;
+    size_t Warmup = 3;
+    size_t Iterations = 25;
+    // Returns the number of heap allocations made so far. Programs that
+    // count their allocations set it, otherwise none are reported.
+    std::function<uint64_t()> Allocations;
+};
+
+struct BenchmarkResult {
+    std::string Name;
+    size_t Ops = 0;
+    // Seconds taken by each timed iteration.
+    std::vector<double> Samples;
+    // Heap allocations per timed iteration.
+    uint64_t Allocations = 0;
+    // Peak resident set size of the process while the workload ran, 0 where
+    // the peak can not be reset between workloads (only Linux can).
+    uint64_t PeakRssKb = 0;
+    // Why an iteration failed, empty when all ran. A failed workload has no
+    // samples.
+    std::string Error;
+
+    double Min() const;
+    double Mean() const;
+    double Percentile(double p) const;
+    double OpsPerSecond() const;
+};
+
+const std::vector<Workload>& Workloads();
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkOptions& options);
+
+std::string ResultsToJson(const std::vector<BenchmarkResult>& results, size_t iterations);
+// Reads results written by ResultsToJson. Returns false when json is malformed.
+bool ResultsFromJson(const std::string& json, std::vector<BenchmarkResult>& results);
+
+// A workload that got slower than its baseline.
+struct Regression {
+    std::string Name;
+    // Change of the median in percent, positive when slower.
+    double Change;
+    // One sided p value of the Mann-Whitney U test that current is slower.
+    double PValue;
+};
+
+// A workload regresses when its median is more than threshold percent slower
+// than the baseline and the samples say so with 95% confidence.
+std::vector<Regression> CompareResults(const std::vector<BenchmarkResult>& baseline,
+                                       const std::vector<BenchmarkResult>& current, double threshold);
+
+// Parses the benchmark command line (--filter, --warmup, --iterations,
+// --json, --compare, --threshold and --list), runs the matching workloads and
+// prints their results. Returns 1 when a workload fails and 2 when --compare
+// finds a regression.
+int BenchmarkMain(const std::vector<std::string>& args, std::function<uint64_t()> allocations = nullptr);
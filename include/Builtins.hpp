@@ -1,15 +1,78 @@
+#include <map>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 #include "Object.hpp"
 
+// Returns the builtin or access function called name, or nullptr.
+std::shared_ptr<IObject> LookupBuiltin(std::string_view name);
+std::shared_ptr<IObject> LookupAccessFunction(std::string_view name);
+std::map<std::string, std::shared_ptr<IObject>> AccessFunctionFields();
+
 std::shared_ptr<IObject> ExitCall(const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> Range(const std::vector<std::shared_ptr<IObject>>& args);
+// iter(value) an iterator over an array, range, the keys of a hash or the
+// events of a midi object, next(iterator) its next value or null at the end.
+std::shared_ptr<IObject> Iter(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> NextValue(const std::vector<std::shared_ptr<IObject>>& args);
+// int(value) a float rounded toward zero, float(value) an integer as a float.
+std::shared_ptr<IObject> ToInteger(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> ToFloat(const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> Print(const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> MakeMidiObject(const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> Random(const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> SetRandomSeed(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> RandomMany(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Shuffle(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> WeightedChoice(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Markov(const std::vector<std::shared_ptr<IObject>>& args);
+// scale(root, name[, octaves]), chord(root, name[, inversion]) and
+// euclid(pulses, steps[, rotation]), the rhythm as an array of 1 and 0.
+std::shared_ptr<IObject> Scale(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Chord(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Euclid(const std::vector<std::shared_ptr<IObject>>& args);
+// map(array, function) and filter(array, function) call function on every
+// element of an array or range, spread over every core for large arrays when
+// function is pure.
+// reduce(array, function, initial) folds the elements into initial in order.
+std::shared_ptr<IObject> Map(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Filter(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Reduce(const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> AllocationStats(const std::vector<std::shared_ptr<IObject>>& args);
 
 std::shared_ptr<IObject> Type(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> AddNote(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
 std::shared_ptr<IObject> Wait(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::vector<uint8_t> EncodeMidi(MidiObj& midi);
 std::shared_ptr<IObject> GenerateMidi(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+// Markov chains: m->Generate(start, n) returns the n states after start and
+// m->Play(midi, start, n, time, velocity) plays them as notes of length time
+// one after the other, returning the last state. Both stop early at a state
+// nothing follows.
+std::shared_ptr<IObject> Generate(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Play(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+// Edits of a whole midi object in one pass over its events, note values and
+// velocities clamped to 0 to 127: midi->Transpose(semitones),
+// ScaleVelocity(percent), Quantize(grid) with a grid like TIME->SIXTEENTH,
+// Humanize(ticks[, seed]) and Stretch(percent). Copy() returns a new midi
+// object with the same notes, to edit a variant.
+std::shared_ptr<IObject> Copy(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Transpose(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> ScaleVelocity(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Quantize(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Humanize(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Stretch(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+// Combining midi objects: midi->Overlay(other[, ticks]) adds the notes of
+// other starting ticks in, Append(other) adds them at the current time of
+// midi and Merge(a, b, ...) overlays any number at the start. The current
+// time becomes the latest end of the parts.
+std::shared_ptr<IObject> Overlay(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Append(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> Merge(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+// Queries by tick: midi->Now() is the current time, NotesAt([tick]) the
+// values of the notes sounding at tick, by default now, and
+// NotesInRange(from, to) those sounding at any tick from up to to.
+std::shared_ptr<IObject> Now(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> NotesAt(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
+std::shared_ptr<IObject> NotesInRange(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args);
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+
+// A function running on a stack of its own on the calling thread. Resume
+// switches to it until it calls Yield or returns. Switching stacks on the same
+// thread rather than starting one keeps the thread locals of the run and the
+// single threaded fast paths of the runtime.
+//
+// The body must have returned before the coroutine is destroyed, the objects
+// on a suspended stack are never destroyed.
+class Coroutine {
+   public:
+    // Pages of the stack are only committed once the body reaches them. The
+    // lowest are a guard, so overflowing the stack faults.
+    Coroutine(std::function<void()> body, size_t stackSize);
+    ~Coroutine();
+    Coroutine(const Coroutine&) = delete;
+    Coroutine& operator=(const Coroutine&) = delete;
+
+    // Whether the stack could be made, Resume does nothing otherwise.
+    bool Valid() const;
+    bool Done() const { return done; }
+    // The lowest address of the stack, which grows down towards it. Zero
+    // until the body has started on some platforms.
+    uintptr_t StackLow() const;
+
+    // Runs the body until it yields or returns. Rethrows what the body throws.
+    void Resume();
+
+    // Switches from the running coroutine back to the one that resumed it.
+    static void Yield();
+    // The coroutine running on this thread, nullptr on the stack of the thread.
+    static Coroutine* Running();
+
+   private:
+    struct Context;
+
+    std::function<void()> body;
+    size_t stackSize;
+    std::unique_ptr<Context> context;
+    Coroutine* resumedBy = nullptr;
+    std::exception_ptr exception;
+    bool done = false;
+};
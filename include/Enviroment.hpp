@@ -5,15 +5,24 @@
 #include "Object.hpp"
 
 using namespace std;
+
+// Counts an enviroment frame in stats, like Counted does for objects.
+void CountEnv(AllocStats* stats, size_t bytes, bool freed);
+
 class Env {
    public:
-    static shared_ptr<BooleanObj> TRUE;
-    static shared_ptr<BooleanObj> FALSE;
-    static shared_ptr<Null> NULLOBJ;
-    static shared_ptr<BreakObj> BREAK;
-
-    Env() {}
-    Env(map<string, shared_ptr<IObject>> fields) : Store(fields) {}
+    // Immortal, so copying them never touches a shared reference count.
+    static const shared_ptr<BooleanObj> TRUE;
+    static const shared_ptr<BooleanObj> FALSE;
+    static const shared_ptr<Null> NULLOBJ;
+    static const shared_ptr<BreakObj> BREAK;
+
+    Env() { Count(); }
+    Env(map<string, shared_ptr<IObject>> fields) : Store(fields) { Count(); }
+    ~Env() {
+        if (!counted) return;
+        if (auto stats = CurrentAllocStats) CountEnv(stats, sizeof(Env), true);
+    }
 
     map<string, shared_ptr<IObject>> Store;
     shared_ptr<Env> Outer;
@@ -28,6 +37,17 @@ class Env {
 
     shared_ptr<IObject> AddEnv(shared_ptr<Env> env);
     std::shared_ptr<IObject> ExtendEnv(std::map<std::string, std::shared_ptr<IObject>> fields);
+
+   private:
+    void Count() {
+        if (auto stats = CurrentAllocStats) {
+            CountEnv(stats, sizeof(Env), false);
+            counted = true;
+        }
+    }
+
+    bool counted = false;
 };
 
 shared_ptr<Env> NewEnclosedEnviroment(shared_ptr<Env> outer);
+shared_ptr<Env> NewGlobalEnviroment();
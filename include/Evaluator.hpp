@@ -8,12 +8,14 @@
 
 using namespace std;
 
-struct Function : public IObject {
+struct Function : public Counted<Function, ObjectType::FUNCTION> {
+    shared_ptr<Identifier> Name;
     vector<shared_ptr<Identifier>> Parameters;
     shared_ptr<BlockStatement> Body;
     shared_ptr<Env> Enviroment;
+    bool IsGenerator = false;
 
-    Function(vector<shared_ptr<Identifier>> p, shared_ptr<BlockStatement> b, shared_ptr<Env> e) : Parameters(p), Body(b), Enviroment(e) {}
+    Function(shared_ptr<Identifier> n, vector<shared_ptr<Identifier>> p, shared_ptr<BlockStatement> b, shared_ptr<Env> e) : Name(n), Parameters(p), Body(b), Enviroment(e) {}
 
     ObjectType Type() override { return ObjectType::FUNCTION; }
     string Inspect() override {
@@ -40,6 +42,8 @@ shared_ptr<IObject> EvalBangOperatorExpression(shared_ptr<IObject> obj);
 shared_ptr<IObject> EvalMinusOperatorExpression(shared_ptr<IObject> obj, int line);
 shared_ptr<IObject> EvalInfixExpression(string op, shared_ptr<IObject> left, shared_ptr<IObject> right, int line);
 shared_ptr<IObject> EvalIntegerInfixExpression(string op, shared_ptr<Integer> left, shared_ptr<Integer> right, int line);
+// Either side may be an integer, made a float.
+shared_ptr<IObject> EvalFloatInfixExpression(string op, double left, double right, int line);
 shared_ptr<IObject> EvalStringInfixExpression(string op, shared_ptr<StringObj> left, shared_ptr<StringObj> right, int line);
 shared_ptr<IObject> EvalIndexExpression(shared_ptr<IObject> left, shared_ptr<IObject> index, int line);
 shared_ptr<IObject> EvalArrayIndexExpression(shared_ptr<ArrayObject> array, shared_ptr<Integer> index);
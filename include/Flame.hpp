@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+const size_t MAX_SHADOW_DEPTH = 1024;
+
+// Samples the user functions being called into collapsed stacks
+// ("main;verse;bar 42" per line) that flamegraph.pl and speedscope read.
+//
+// The interpreter keeps a shadow stack of function names in ApplyFunction and
+// a sampler thread copies it on every interval. Names point into the AST, so
+// the program must outlive Stop().
+class FlameSampler {
+   public:
+    FlameSampler(std::string root, std::chrono::microseconds interval = std::chrono::milliseconds(1));
+    ~FlameSampler();
+
+    void Start();
+    void Stop();
+
+    // Called by the evaluating thread only.
+    void Push(const std::string* name);
+    void Pop();
+
+    // Writes the samples in collapsed stack format.
+    bool Write(const std::string& fileName) const;
+
+    // Number of samples taken per collapsed stack.
+    std::map<std::string, uint64_t> Samples;
+
+   private:
+    void Sample();
+
+    std::string root;
+    std::chrono::microseconds interval;
+
+    std::array<std::atomic<const std::string*>, MAX_SHADOW_DEPTH> frames;
+    std::atomic<size_t> depth = 0;
+    // Changes on every push and pop, so the sampler can tell when the stack
+    // moved while it was copying it.
+    std::atomic<uint64_t> version = 0;
+
+    std::thread sampler;
+    std::mutex mutex;
+    std::condition_variable stopped;
+    bool running = false;
+};
+
+// The sampler of this thread, nullptr when not sampling.
+inline constinit thread_local FlameSampler* CurrentFlame = nullptr;
+
+// Keeps a user function on the shadow stack for the lifetime of the scope.
+class FlameFrame {
+   public:
+    FlameFrame(const std::string& name) : flame(CurrentFlame) {
+        if (flame != nullptr) flame->Push(&name);
+    }
+    ~FlameFrame() {
+        if (flame != nullptr) flame->Pop();
+    }
+
+   private:
+    FlameSampler* flame;
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AllocStats.hpp"
+#include "Ast.hpp"
+#include "Enviroment.hpp"
+#include "Limits.hpp"
+#include "Flame.hpp"
+#include "Object.hpp"
+#include "Profiler.hpp"
+#include "Random.hpp"
+#include "Trace.hpp"
+
+// The state of one run of a program. Builtins reach the interpreter that is
+// running on their thread through Interpreter::Current(), so any number of
+// interpreters can run side by side on different threads.
+//
+// A program is compiled once and can be run any number of times, by any
+// number of interpreters:
+//
+//   Interpreter interpreter;
+//   interpreter.WriteFiles = false;
+//   auto program = interpreter.Load("song.ml");
+//   interpreter.Run(program, {{"tempo", NewInteger(120)}});
+//   for (const auto& midi : interpreter.Midis) { ... midi->Notes ... }
+class Interpreter {
+   public:
+    Interpreter();
+
+    // Parses source and starts parsing its includes relative to baseDir.
+    // Returns nullptr and fills Errors when source does not parse.
+    std::shared_ptr<AstProgram> Compile(const std::string& source, const std::string& baseDir = "");
+    // Reads and compiles fileName.
+    std::shared_ptr<AstProgram> Load(const std::string& fileName);
+
+    // Runs program in a fresh global enviroment that also holds globals.
+    std::shared_ptr<IObject> Run(std::shared_ptr<AstProgram> program,
+                                 const std::map<std::string, std::shared_ptr<IObject>>& globals = {});
+    // Runs program in the global enviroment of the previous run, like the repl.
+    std::shared_ptr<IObject> Evaluate(std::shared_ptr<AstProgram> program);
+
+    // A global variable of the last run, or nullptr.
+    std::shared_ptr<IObject> Get(const std::string& name);
+
+    std::vector<std::string> Errors;
+    std::shared_ptr<Env> Globals;
+    // The included files evaluated by the current run, by path. nullptr while
+    // a file is being evaluated.
+    std::map<std::string, std::shared_ptr<IObject>> Modules;
+
+    // Every midi object made by the last run.
+    std::vector<std::shared_ptr<MidiObj>> Midis;
+    // When false GenerateMidi keeps the encoded file in Files instead of
+    // writing it to disk.
+    bool WriteFiles = true;
+    std::map<std::string, std::vector<uint8_t>> Files;
+
+    // Draws the numbers of random(), seeded from the system unless SetSeed
+    // is called.
+    Xoshiro256 Rng;
+    // The seed of the run, {seed} in OutputTemplate.
+    uint32_t Seed;
+    void SetSeed(uint32_t seed);
+
+    // Where print writes to, std::cout unless set.
+    std::ostream* Output;
+    // Relative GenerateMidi file names are created in this directory.
+    std::string OutputDir;
+    // When set, replaces the file name GenerateMidi is given, keeping its
+    // directory. {name} is the given name without extension, {i} is
+    // Variation and {seed} is Seed, e.g. "{name}_{i}.midi".
+    std::string OutputTemplate;
+    size_t Variation = 0;
+    // Collects where the time of every run goes when set.
+    Profiler* Profile = nullptr;
+    // Samples the user function stack of every run when set.
+    FlameSampler* Flame = nullptr;
+    // Counts the objects every run allocates when set, see stats().
+    AllocStats* Stats = nullptr;
+    // Records read, lex, parse, evaluate and GenerateMidi spans when set.
+    Tracer* Trace = nullptr;
+    // Ends a run with an error once it does more work than allowed.
+    RunLimits Limits;
+
+    // The interpreter running on this thread, or nullptr.
+    static Interpreter* Current();
+};
+
+std::string ResolveOutputPath(const std::string& fileName);
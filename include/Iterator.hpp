@@ -0,0 +1,103 @@
+#pragma once
+#include <memory>
+#include <optional>
+
+#include "Coroutine.hpp"
+#include "Limits.hpp"
+#include "Object.hpp"
+
+class Env;
+struct Function;
+
+// Values produced one at a time, which for loops take as they go.
+class IIterator {
+   public:
+    virtual ~IIterator() = default;
+    // The next value, nullptr after the last one, or an error or exit.
+    virtual std::shared_ptr<IObject> Next() = 0;
+};
+
+// The elements of an array, including those added while iterating.
+struct ArrayIterator : public Counted<ArrayIterator, ObjectType::ITERATOR>, public IIterator {
+    std::shared_ptr<ArrayObject> Array;
+    size_t Position = 0;
+
+    ArrayIterator(std::shared_ptr<ArrayObject> array) : Array(std::move(array)) {}
+    ObjectType Type() override { return ObjectType::ITERATOR; }
+    std::string Inspect() override { return "iterator(" + Array->Inspect() + ")"; }
+    std::shared_ptr<IObject> Next() override;
+};
+
+struct RangeIterator : public Counted<RangeIterator, ObjectType::ITERATOR>, public IIterator {
+    int Value;
+    int High;
+    int Steps;
+
+    RangeIterator(const IterObj& range) : Value(range.Low), High(range.High), Steps(range.Steps) {}
+    ObjectType Type() override { return ObjectType::ITERATOR; }
+    std::string Inspect() override { return "iterator(range)"; }
+    std::shared_ptr<IObject> Next() override;
+};
+
+// The keys of a hash in key order, looked up again on every step so pairs
+// may be added while iterating.
+struct HashKeyIterator : public Counted<HashKeyIterator, ObjectType::ITERATOR>, public IIterator {
+    std::shared_ptr<Hash> Of;
+    std::optional<HashKey> Last;
+
+    HashKeyIterator(std::shared_ptr<Hash> hash) : Of(std::move(hash)) {}
+    ObjectType Type() override { return ObjectType::ITERATOR; }
+    std::string Inspect() override { return "iterator(hash)"; }
+    std::shared_ptr<IObject> Next() override;
+};
+
+// The note events of a midi object in the order they were added, as hashes
+// of note, velocity, time and on.
+struct MidiEventIterator : public Counted<MidiEventIterator, ObjectType::ITERATOR>, public IIterator {
+    std::shared_ptr<MidiObj> Midi;
+    size_t Position = 0;
+
+    MidiEventIterator(std::shared_ptr<MidiObj> midi) : Midi(std::move(midi)) {}
+    ObjectType Type() override { return ObjectType::ITERATOR; }
+    std::string Inspect() override { return "iterator(midi)"; }
+    std::shared_ptr<IObject> Next() override;
+};
+
+class GeneratorObj;
+
+// The generator running on this thread, nullptr outside of generators.
+inline constinit thread_local GeneratorObj* CurrentGenerator = nullptr;
+
+// A call of a generator function. Its body runs on a stack of its own up to
+// the next yield every time a value is taken, so it can produce endless
+// sequences. A generator that is dropped before it ends is unwound from the
+// yield it stopped at.
+class GeneratorObj : public Counted<GeneratorObj, ObjectType::ITERATOR>, public IIterator {
+   public:
+    GeneratorObj(std::shared_ptr<Function> function, std::shared_ptr<Env> env);
+    ~GeneratorObj();
+
+    ObjectType Type() override { return ObjectType::ITERATOR; }
+    std::string Inspect() override;
+    std::shared_ptr<IObject> Next() override;
+
+    // Called by the yield statements of the body, returns an error when the
+    // generator is dropped before it ends.
+    std::shared_ptr<IObject> Yield(std::shared_ptr<IObject> value, int line);
+
+   private:
+    void Resume();
+
+    std::shared_ptr<Function> function;
+    std::shared_ptr<Env> env;
+    std::unique_ptr<Coroutine> body;
+    CallStack calls;
+    std::shared_ptr<IObject> value;
+    std::shared_ptr<IObject> result;
+    bool running = false;
+    bool closing = false;
+};
+
+// An iterator over obj, nullptr when obj cannot be iterated. Iterators are
+// iterated themselves.
+std::shared_ptr<IObject> Iterate(const std::shared_ptr<IObject>& obj);
@@ -8,8 +8,11 @@
 class Lexer {
    public:
     Lexer(std::string input) : Input(input) { ReadChar(); }
+    Lexer(std::string input, size_t firstLine) : Input(input), line(firstLine) { ReadChar(); }
 
     Token NextToken();
+    // Offset into Input of the first character of the last token returned.
+    size_t TokenStart() const { return tokenStart; }
 
     std::string Input;
 
@@ -33,9 +36,13 @@ class Lexer {
         {"return", TokenType::RETURN},
         {"break", TokenType::BREAK},
         {"for", TokenType::FOR},
-        {"in", TokenType::IN}};
+        {"in", TokenType::IN},
+        {"include", TokenType::INCLUDE},
+        {"voice", TokenType::VOICE},
+        {"yield", TokenType::YIELD}};
 
     size_t position = 0;
+    size_t tokenStart = 0;
     size_t readPosition = 0;
     char ch;
     size_t line = 1;
@@ -0,0 +1,94 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "AllocStats.hpp"
+#include "Object.hpp"
+
+// Bounds on the work one run may do, zero means unlimited.
+struct RunLimits {
+    // Loop iterations plus function calls.
+    uint64_t MaxSteps = 0;
+    std::chrono::milliseconds Timeout = std::chrono::milliseconds(0);
+    // Bytes of live objects, including the characters of strings and the
+    // elements of arrays and hashes.
+    int64_t MaxHeapBytes = 0;
+    // Note on and off events per midi object.
+    size_t MaxMidiEvents = 0;
+    // User function calls in progress at once. Calls also fail before the
+    // native stack runs out, whatever this is.
+    size_t MaxDepth = 100000;
+
+    // Whether a Budget is needed, the depth is always checked.
+    bool Any() const { return MaxSteps != 0 || Timeout.count() != 0 || MaxHeapBytes != 0 || MaxMidiEvents != 0; }
+};
+
+// Tracks one run against its limits.
+class Budget {
+   public:
+    Budget(const RunLimits& limits, const AllocStats* heap);
+
+    // Counts a step at line, returns an error once a limit is exceeded.
+    std::shared_ptr<IObject> Step(int line);
+    // Returns an error when count more elements of size bytes would exceed
+    // the heap limit.
+    std::shared_ptr<IObject> Room(uint64_t count, size_t size) const;
+
+    const RunLimits& Limits;
+
+   private:
+    const AllocStats* heap;
+    uint64_t steps = 0;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+// The budget of this thread, nullptr when the run is unlimited.
+inline constinit thread_local Budget* CurrentBudget = nullptr;
+
+// Called on loop back edges and function calls. Returns nullptr while the
+// run is within its limits.
+inline std::shared_ptr<IObject> CheckBudget(int line) {
+    if (auto budget = CurrentBudget) return budget->Step(line);
+    return nullptr;
+}
+
+// Called by builtins before they allocate count elements of size bytes at
+// once, which a step would only see after the memory is taken. Returns nullptr
+// while the run has room for them.
+inline std::shared_ptr<IObject> CheckHeap(uint64_t count, size_t size) {
+    if (auto budget = CurrentBudget) return budget->Room(count, size);
+    return nullptr;
+}
+
+// The user function calls in progress on the thread of a run.
+struct CallStack {
+    size_t Depth = 0;
+    size_t MaxDepth = 0;
+    // Calls fail once the native stack grows below this address, zero when
+    // the bounds of the stack are unknown.
+    uintptr_t Limit = 0;
+};
+
+inline constinit thread_local CallStack* CurrentCallStack = nullptr;
+
+// Room left below the last user function call for builtins and the
+// expressions that call them.
+const size_t STACK_MARGIN = 256 * 1024;
+
+// Counts a user function call for the lifetime of the scope.
+class CallFrame {
+   public:
+    CallFrame() : stack(CurrentCallStack) {
+        if (stack != nullptr) stack->Depth++;
+    }
+    ~CallFrame() {
+        if (stack != nullptr) stack->Depth--;
+    }
+
+    // Returns an error when the call is nested too deep.
+    std::shared_ptr<IObject> Check(int line) const;
+
+   private:
+    CallStack* stack;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Ast.hpp"
+#include "Enviroment.hpp"
+#include "Object.hpp"
+
+// The evaluated top level of an included file. Every include of the same file
+// in one interpreter shares one ModuleObj and reads its Exports without
+// copying, so the objects and closures it defines are shared by every
+// includer of the run.
+struct ModuleObj : public Counted<ModuleObj, ObjectType::INCLUDE> {
+    std::string Path;
+    std::shared_ptr<Env> Exports;
+
+    ModuleObj(std::string path, std::shared_ptr<Env> exports) : Path(path), Exports(exports) {}
+    ObjectType Type() override { return ObjectType::INCLUDE; }
+    std::string Inspect() override { return "module(" + Path + ")"; }
+};
+
+struct ParsedModule {
+    std::shared_ptr<AstProgram> Program;
+    std::vector<std::string> Errors;
+};
+
+class ModuleCache {
+   public:
+    static ModuleCache& Instance();
+
+    // Resolves the include statements of program against baseDir and starts
+    // parsing every file that is not cached yet, each on its own thread.
+    void Prefetch(std::shared_ptr<AstProgram> program, const std::string& baseDir);
+
+    // Returns the ModuleObj for path, or an Error when the file can not be
+    // read, parsed or evaluated. Parses are shared by the whole process, but
+    // a module is evaluated once per interpreter, in Interpreter::Modules, so
+    // concurrent runs never share its objects.
+    std::shared_ptr<IObject> Load(const std::string& path, int line);
+
+    // Drops every file that changed on disk since it was parsed. Returns true
+    // when something was dropped.
+    bool Refresh();
+
+   private:
+    struct Entry {
+        std::shared_future<ParsedModule> Parsed;
+        std::filesystem::file_time_type ModifiedAt;
+    };
+
+    ModuleCache() {}
+    std::shared_future<ParsedModule> StartParse(const std::string& path);
+
+    std::mutex mutex;
+    std::map<std::string, Entry> modules;
+};
+
+std::string ResolveModulePath(const std::string& path, const std::string& baseDir);
+bool ReadSourceFile(const std::string& fileName, std::string& content);
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MidiNoteEvent;
+
+// Answers which notes of a midi object sound at a time. Notes are kept sorted
+// by start with the running maximum of their ends, so the notes that can
+// still sound at t begin at the first entry whose running end is past t,
+// found by binary search like the last entry starting before t.
+//
+// The index follows MidiObj::Notes by itself: notes added after the last
+// query in time order are appended, anything else rebuilds it. Edits that
+// move notes in time call Invalidate.
+class NoteIndex {
+   public:
+    // Indices into notes of the on events of the notes sounding at any time
+    // in [from, to), in order of their start.
+    std::vector<size_t> Sounding(const std::vector<MidiNoteEvent>& notes, uint32_t from, uint32_t to);
+
+    void Invalidate() { indexed = 0; }
+
+   private:
+    struct Entry {
+        uint32_t Start;
+        uint32_t End;
+        size_t Event;
+    };
+
+    void Update(const std::vector<MidiNoteEvent>& notes);
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> maxEnd;
+    // Notes indexed so far, each an on and an off event.
+    size_t indexed = 0;
+};
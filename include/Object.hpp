@@ -3,16 +3,23 @@
 #include <fmt/core.h>
 #include <fmt/format.h>
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include <algorithm>
 
+#include "NoteIndex.hpp"
+#include "Random.hpp"
+
 enum class ObjectType {
     INTEGER,
+    FLOAT,
     BOOLEAN,
     STRING,
     NULL_OBJ,
@@ -29,6 +36,8 @@ enum class ObjectType {
     MIDI,
     NOTE,
     TIME,
+    MARKOV,
+    ITERATOR,
 };
 
 const int TICKS_PER_QUARTER = 480;
@@ -65,6 +74,9 @@ struct fmt::formatter<ObjectType> {
             case ObjectType::INTEGER:
                 typeStr = "INTEGER";
                 break;
+            case ObjectType::FLOAT:
+                typeStr = "FLOAT";
+                break;
             case ObjectType::BOOLEAN:
                 typeStr = "BOOLEAN";
                 break;
@@ -113,10 +125,85 @@ struct fmt::formatter<ObjectType> {
             case ObjectType::TIME:
                 typeStr = "TIME";
                 break;
+            case ObjectType::MARKOV:
+                typeStr = "MARKOV";
+                break;
+            case ObjectType::ITERATOR:
+                typeStr = "ITERATOR";
+                break;
         }
         return fmt::format_to(ctx.out(), "{}", typeStr);
     }
 };
+class AllocStats;
+
+// The allocation statistics of this thread, nullptr when not counting.
+inline constinit thread_local AllocStats* CurrentAllocStats = nullptr;
+void CountAllocation(AllocStats* stats, ObjectType type, size_t bytes);
+void CountFree(AllocStats* stats, ObjectType type, size_t bytes);
+void CountOwnedBytes(AllocStats* stats, int64_t bytes);
+
+// Base of every object type, counts its objects in CurrentAllocStats. Only an
+// object that was counted when it was made is subtracted when it is freed,
+// and not on a thread that counts nothing.
+template <typename T, ObjectType TYPE>
+class Counted : public IObject {
+   protected:
+    constexpr Counted() { Count(); }
+    constexpr Counted(const Counted&) : IObject() { Count(); }
+    constexpr Counted& operator=(const Counted&) { return *this; }
+    constexpr ~Counted() {
+        if (std::is_constant_evaluated() || !counted) return;
+        if (auto stats = CurrentAllocStats) CountFree(stats, TYPE, sizeof(T));
+    }
+
+   private:
+    constexpr void Count() {
+        if (std::is_constant_evaluated()) return;
+        if (auto stats = CurrentAllocStats) {
+            CountAllocation(stats, TYPE, sizeof(T));
+            counted = true;
+        }
+    }
+
+    bool counted = false;
+};
+
+// Counts memory an object owns besides itself, such as the characters of a
+// string, as live bytes in CurrentAllocStats for as long as the object lives.
+// Like Counted, bytes not counted when the object was made are never
+// subtracted.
+class OwnedBytes {
+   public:
+    OwnedBytes(size_t bytes) : bytes(bytes) {
+        if (auto stats = CurrentAllocStats) {
+            CountOwnedBytes(stats, bytes);
+            counted = true;
+        }
+    }
+    OwnedBytes(const OwnedBytes& other) : OwnedBytes(other.bytes) {}
+    OwnedBytes& operator=(const OwnedBytes& other) {
+        Resize(other.bytes);
+        return *this;
+    }
+    ~OwnedBytes() {
+        if (!counted) return;
+        if (auto stats = CurrentAllocStats) CountOwnedBytes(stats, -(int64_t)bytes);
+    }
+
+    // For objects that grow or shrink after they are made.
+    void Resize(size_t size) {
+        if (auto stats = CurrentAllocStats; stats != nullptr && counted) {
+            CountOwnedBytes(stats, (int64_t)size - (int64_t)bytes);
+        }
+        bytes = size;
+    }
+
+   private:
+    size_t bytes;
+    bool counted = false;
+};
+
 // Forward declare HashKey
 struct HashKey;
 
@@ -126,7 +213,7 @@ class IHashable {
     virtual HashKey GetHashKey() = 0;
 };
 
-struct ExitObject : public IObject {
+struct ExitObject : public Counted<ExitObject, ObjectType::EXIT> {
     int Value;
 
     ExitObject(int val) : Value(val) {}
@@ -134,30 +221,73 @@ struct ExitObject : public IObject {
     std::string Inspect() override { return std::to_string(Value); }
 };
 
-struct Integer : public IObject, public IHashable {
+struct Integer : public Counted<Integer, ObjectType::INTEGER>, public IHashable {
     int Value;
 
-    Integer(int val) : Value(val) {}
+    constexpr Integer(int val) : Value(val) {}
     ObjectType Type() override { return ObjectType::INTEGER; }
     std::string Inspect() override { return std::to_string(Value); }
     HashKey GetHashKey() override;
 };
 
-struct BooleanObj : public IObject, public IHashable {
+// Wraps an object with static storage duration in a shared_ptr that owns
+// nothing, so copies of it never touch a reference count.
+template <typename T>
+std::shared_ptr<T> Immortal(T& obj) {
+    return std::shared_ptr<T>(std::shared_ptr<T>(), &obj);
+}
+
+// Integers in this range are constants that are never allocated, since
+// integer objects are immutable once created.
+const int SMALL_INT_MIN = -128;
+const int SMALL_INT_MAX = 1023;
+extern std::array<Integer, SMALL_INT_MAX - SMALL_INT_MIN + 1> SmallIntegers;
+
+inline std::shared_ptr<Integer> NewInteger(int value) {
+    if (value >= SMALL_INT_MIN && value <= SMALL_INT_MAX) {
+        return Immortal(SmallIntegers[value - SMALL_INT_MIN]);
+    }
+    return std::make_shared<Integer>(value);
+}
+
+struct FloatObj : public Counted<FloatObj, ObjectType::FLOAT> {
+    double Value;
+
+    constexpr FloatObj(double val) : Value(val) {}
+    ObjectType Type() override { return ObjectType::FLOAT; }
+    std::string Inspect() override {
+        // The shortest text that reads back as the same value, with a point so
+        // 1.0 does not print like the integer 1.
+        auto text = fmt::format("{}", Value);
+        if (text.find_first_of(".einf") == std::string::npos) text += ".0";
+        return text;
+    }
+};
+
+inline std::shared_ptr<FloatObj> NewFloat(double value) { return std::make_shared<FloatObj>(value); }
+
+// Integers and floats mix in arithmetic, as floats.
+inline bool IsNumber(IObject& obj) { return obj.Type() == ObjectType::INTEGER || obj.Type() == ObjectType::FLOAT; }
+inline double NumberValue(IObject& obj) {
+    if (obj.Type() == ObjectType::FLOAT) return static_cast<FloatObj&>(obj).Value;
+    return static_cast<Integer&>(obj).Value;
+}
+
+struct BooleanObj : public Counted<BooleanObj, ObjectType::BOOLEAN>, public IHashable {
     bool Value;
     BooleanObj() {}
-    BooleanObj(bool val) : Value(val) {}
+    constexpr BooleanObj(bool val) : Value(val) {}
     ObjectType Type() override { return ObjectType::BOOLEAN; }
     std::string Inspect() override { return std::to_string(Value); }
     HashKey GetHashKey() override;
 };
 
-struct Null : public IObject {
+struct Null : public Counted<Null, ObjectType::NULL_OBJ> {
     ObjectType Type() override { return ObjectType::NULL_OBJ; }
     std::string Inspect() override { return "null"; }
 };
 
-struct ReturnValue : public IObject {
+struct ReturnValue : public Counted<ReturnValue, ObjectType::RETURN_VALUE> {
     std::shared_ptr<IObject> Value;
 
     ReturnValue(std::shared_ptr<IObject> val) : Value(val) {}
@@ -165,49 +295,51 @@ struct ReturnValue : public IObject {
     std::string Inspect() override { return Value->Inspect(); }
 };
 
-struct BreakObj : public IObject {
+struct BreakObj : public Counted<BreakObj, ObjectType::BREAK> {
     ObjectType Type() override { return ObjectType::BREAK; }
     std::string Inspect() override { return "break"; }
 };
 
-struct Error : public IObject {
+struct Error : public Counted<Error, ObjectType::ERROR> {
     std::string Message;
     Error(std::string msg) : Message(msg) {}
     ObjectType Type() override { return ObjectType::ERROR; }
     std::string Inspect() override { return "ERROR: " + Message; }
 };
 
-struct StringObj : public IObject, public IHashable {
+struct StringObj : public Counted<StringObj, ObjectType::STRING>, public IHashable {
     std::string Value;
-    StringObj(std::string val) : Value(val) {}
+    OwnedBytes Owned;
+    StringObj(std::string val) : Value(val), Owned(Value.capacity()) {}
     ObjectType Type() override { return ObjectType::STRING; }
     std::string Inspect() override { return Value; }
     HashKey GetHashKey() override;
 };
 
-using BuiltinFunction = std::function<std::shared_ptr<IObject>(const std::vector<std::shared_ptr<IObject>> params)>;
-struct BuiltinObj : public IObject {
+using BuiltinFunction = std::shared_ptr<IObject> (*)(const std::vector<std::shared_ptr<IObject>>& params);
+struct BuiltinObj : public Counted<BuiltinObj, ObjectType::FUNCTION> {
     BuiltinFunction Function;
 
-    BuiltinObj(BuiltinFunction func) : Function(func) {}
+    constexpr BuiltinObj(BuiltinFunction func) : Function(func) {}
     ObjectType Type() override { return ObjectType::FUNCTION; }
     std::string Inspect() override { return "builtin obj"; }
 };
 
-using AccessFunction = std::function<std::shared_ptr<IObject>(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>> params)>;
-struct AccessFuncObj : public IObject {
+using AccessFunction = std::shared_ptr<IObject> (*)(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& params);
+struct AccessFuncObj : public Counted<AccessFuncObj, ObjectType::FUNCTION> {
     AccessFunction Function;
 
-    AccessFuncObj(AccessFunction func) : Function(func) {}
+    constexpr AccessFuncObj(AccessFunction func) : Function(func) {}
     ObjectType Type() override { return ObjectType::FUNCTION; }
     std::string Inspect() override { return "builtin obj"; }
 };
 
-struct ArrayObject : public IObject {
+struct ArrayObject : public Counted<ArrayObject, ObjectType::ARRAY> {
     std::vector<std::shared_ptr<IObject>> Elements;
+    OwnedBytes Owned;
 
-    ArrayObject() {}
-    ArrayObject(std::vector<std::shared_ptr<IObject>> e) : Elements(e) {}
+    ArrayObject() : Owned(0) {}
+    ArrayObject(std::vector<std::shared_ptr<IObject>> e) : Elements(e), Owned(Elements.capacity() * sizeof(Elements[0])) {}
     ObjectType Type() override { return ObjectType::ARRAY; }
     std::string Inspect() override {
         std::string temp = "[";
@@ -241,9 +373,10 @@ struct HashKey {
     }
 
     HashKey(StringObj& string) {
-        Value = 0;
+        // FNV-1a, a plain sum made "live" and "evil" the same key.
+        Value = 14695981039346656037ull;
         for (const auto& ch : string.Value) {
-            Value += ch;
+            Value = (Value ^ (uint8_t)ch) * 1099511628211ull;
         }
         Type = string.Type();
     }
@@ -259,10 +392,15 @@ struct HashPair {
         : Key(key), Value(val) {}
 };
 
-struct Hash : public IObject {
+struct Hash : public Counted<Hash, ObjectType::HASH> {
+    // A pair and the node of the map holding it.
+    static constexpr size_t PAIR_BYTES = sizeof(HashKey) + sizeof(HashPair) + 32;
+
     std::map<HashKey, HashPair> Pairs;
+    // Resized when index assignment adds pairs.
+    OwnedBytes Owned;
 
-    Hash(std::map<HashKey, HashPair> p) : Pairs(p) {}
+    Hash(std::map<HashKey, HashPair> p) : Pairs(p), Owned(Pairs.size() * PAIR_BYTES) {}
     ObjectType Type() override { return ObjectType::HASH; }
     std::string Inspect() override {
         std::string temp = "{";
@@ -278,7 +416,7 @@ struct Hash : public IObject {
     }
 };
 
-struct IterObj : public IObject {
+struct IterObj : public Counted<IterObj, ObjectType::ITER> {
     int Low;
     int High;
     int Steps;
@@ -300,7 +438,7 @@ struct MidiNoteEvent {
     MidiNoteEvent(int note, int vel, int time, bool isOnEvent) :
         Note(note), Velocity(vel), Time(time), IsOnEvent(isOnEvent) {}
     
-    std::vector<uint8_t> GenerateVariableLengthQuantity(uint32_t value) {
+    std::vector<uint8_t> GenerateVariableLengthQuantity(uint32_t value) const {
         std::vector<uint8_t> buffer;
         buffer.push_back(value & 0x7F);
         value >>= 7;
@@ -312,7 +450,7 @@ struct MidiNoteEvent {
         return buffer;
     }
 
-    std::vector<uint8_t> GenerateEvent(uint32_t lastTime) {
+    std::vector<uint8_t> GenerateEvent(uint32_t lastTime) const {
         std::vector<uint8_t> event;
         auto deltaTimeBytes = GenerateVariableLengthQuantity(Time - lastTime);
         event.insert(event.end(), deltaTimeBytes.begin(), deltaTimeBytes.end());
@@ -330,9 +468,13 @@ struct MidiNoteEvent {
     }
 };
 
-struct MidiObj : public IObject {
+struct MidiObj : public Counted<MidiObj, ObjectType::MIDI> {
+    // Every note is its on event followed by its off event, in the order the
+    // notes were added. EncodeMidi sorts a copy.
     std::vector<MidiNoteEvent> Notes;
     int currentTime = 0;
+    // Call Index.Invalidate() after moving notes in time.
+    NoteIndex Index;
 
     ObjectType Type() override { return ObjectType::MIDI; }
     std::string Inspect() override {
@@ -340,20 +482,72 @@ struct MidiObj : public IObject {
     }
 };
 
-struct NoteObj : public IObject {
-    std::map<std::string, std::shared_ptr<IObject>> Fields;
+// Returns the midi value of a note name such as C5 or Bb3, or -1 when name
+// is not a note. Only the flats Db, Eb, Gb, Ab and Bb are note names.
+constexpr int ParseNoteName(std::string_view name) {
+    if (name.size() < 2) return -1;
+
+    int semitone = 0;
+    switch (name[0]) {
+        case 'C': semitone = 0; break;
+        case 'D': semitone = 2; break;
+        case 'E': semitone = 4; break;
+        case 'F': semitone = 5; break;
+        case 'G': semitone = 7; break;
+        case 'A': semitone = 9; break;
+        case 'B': semitone = 11; break;
+        default: return -1;
+    }
 
-    NoteObj() {
-        for (int i = 0; i < 11; ++i) {
-            int j = 0;
-            for (const std::string ch : {"C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B" }) {
-                int value = j + i * 12;
-                if (value > 127) break;
+    size_t i = 1;
+    if (name[i] == 'b') {
+        if (semitone == 0 || semitone == 5) return -1;
+        semitone--;
+        i++;
+    }
 
-                Fields[ch + std::to_string(i)] = std::make_shared<Integer>(value);
-                j++;
+    std::string_view octave = name.substr(i);
+    if (octave.empty() || octave.size() > 2 || (octave.size() == 2 && octave[0] == '0')) return -1;
+
+    int value = 0;
+    for (char ch : octave) {
+        if (ch < '0' || ch > '9') return -1;
+        value = value * 10 + (ch - '0');
+    }
+
+    value = semitone + value * 12;
+    return value > 127 ? -1 : value;
+}
+
+static_assert(ParseNoteName("C0") == 0);
+static_assert(ParseNoteName("C5") == 60);
+static_assert(ParseNoteName("Bb3") == 46);
+static_assert(ParseNoteName("G10") == 127);
+static_assert(ParseNoteName("Ab10") == -1);
+static_assert(ParseNoteName("Cb4") == -1);
+
+struct NoteObj : public Counted<NoteObj, ObjectType::NOTE> {
+    std::shared_ptr<IObject> Get(std::string_view name) {
+        int value = ParseNoteName(name);
+        if (value < 0) return nullptr;
+        return NewInteger(value);
+    }
+
+    // Every note as a field, built the first time an access expression
+    // needs more than a single note name.
+    static const std::map<std::string, std::shared_ptr<IObject>>& Fields() {
+        static const auto fields = [] {
+            std::map<std::string, std::shared_ptr<IObject>> fields;
+            for (int i = 0; i < 11; ++i) {
+                for (const std::string ch : {"C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B"}) {
+                    std::string name = ch + std::to_string(i);
+                    if (ParseNoteName(name) < 0) break;
+                    fields[name] = NewInteger(ParseNoteName(name));
+                }
             }
-        }
+            return fields;
+        }();
+        return fields;
     }
 
     ObjectType Type() override { return ObjectType::NOTE; }
@@ -362,19 +556,38 @@ struct NoteObj : public IObject {
     }
 };
 
-struct TimeObj : public IObject {
-    std::map<std::string, std::shared_ptr<IObject>> Fields;
-
-    TimeObj() {
-        Fields = {
-            {"WHOLE", std::make_shared<Integer>(1)},
-            {"HALF", std::make_shared<Integer>(2)},
-            {"QUARTER", std::make_shared<Integer>(4)},
-            {"EIGHTH", std::make_shared<Integer>(8)},
-            {"SIXTEENTH", std::make_shared<Integer>(16)},
-            {"THIRTY_SECOND", std::make_shared<Integer>(32)},
-            {"SIXTY_FOURTH", std::make_shared<Integer>(64)},
-        };
+struct TimeField {
+    std::string_view Name;
+    int Value;
+};
+
+constexpr TimeField TIME_FIELDS[] = {
+    {"WHOLE", 1},
+    {"HALF", 2},
+    {"QUARTER", 4},
+    {"EIGHTH", 8},
+    {"SIXTEENTH", 16},
+    {"THIRTY_SECOND", 32},
+    {"SIXTY_FOURTH", 64},
+};
+
+struct TimeObj : public Counted<TimeObj, ObjectType::TIME> {
+    std::shared_ptr<IObject> Get(std::string_view name) {
+        for (const auto& field : TIME_FIELDS) {
+            if (field.Name == name) return NewInteger(field.Value);
+        }
+        return nullptr;
+    }
+
+    static const std::map<std::string, std::shared_ptr<IObject>>& Fields() {
+        static const auto fields = [] {
+            std::map<std::string, std::shared_ptr<IObject>> fields;
+            for (const auto& field : TIME_FIELDS) {
+                fields[std::string(field.Name)] = NewInteger(field.Value);
+            }
+            return fields;
+        }();
+        return fields;
     }
 
     ObjectType Type() override { return ObjectType::TIME; }
@@ -382,3 +595,27 @@ struct TimeObj : public IObject {
         return "Time";
     }
 };
+
+// A Markov chain made by markov(table). Every state keeps the states that can
+// follow it with an alias table over their weights, so a step is O(1).
+struct MarkovObj : public Counted<MarkovObj, ObjectType::MARKOV> {
+    struct State {
+        std::shared_ptr<IObject> Value;
+        // Indices into States, empty for a state nothing follows.
+        std::vector<size_t> Next;
+        std::unique_ptr<AliasTable> Table;
+    };
+
+    std::vector<State> States;
+    std::map<HashKey, size_t> Index;
+
+    // The index of the state after state, or -1 when nothing follows it.
+    int64_t Step(size_t state, Xoshiro256& rng) const {
+        const auto& from = States[state];
+        if (from.Next.empty()) return -1;
+        return from.Next[from.Table->Sample(rng)];
+    }
+
+    ObjectType Type() override { return ObjectType::MARKOV; }
+    std::string Inspect() override { return fmt::format("markov({0} states)", States.size()); }
+};
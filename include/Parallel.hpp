@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Set on the threads running a ParallelFor body, including the caller while it
+// helps. Objects that change as they are read, like iterators, must not be
+// used there.
+inline constinit thread_local bool InParallelWorker = false;
+
+// The threads a ParallelFor runs on, the caller included. One when the
+// machine has a single core.
+size_t ParallelThreads();
+
+// Calls body(begin, end) for chunks of at most chunk indices covering 0 to
+// count, on a pool of threads started the first time it is needed. Every
+// thread is given an equal share and takes chunks from the shares of the
+// others once its own is done.
+// Returns false without calling body when the pool is busy with another
+// call, or has no threads. Rethrows what body throws.
+bool ParallelFor(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& body);
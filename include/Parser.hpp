@@ -29,6 +29,10 @@ class Parser {
     Lexer lexer;
     Token curToken;
     Token peekToken;
+    std::string baseDir;
+    // Function literals being parsed, and whether the innermost yields.
+    int functionDepth = 0;
+    bool yielded = false;
     std::unordered_map<TokenType, PrefixParseFn> prefixParseFns;
     std::unordered_map<TokenType, InfixParseFn> infixParseFns;
     std::unordered_map<TokenType, Precedence> precedences = std::unordered_map<TokenType, Precedence>({
@@ -52,6 +56,9 @@ class Parser {
     std::shared_ptr<LetStatement> ParseLetStatement();
     std::shared_ptr<ReturnStatement> ParseReturnStatement();
     std::shared_ptr<BreakStatement> ParseBreakStatement();
+    std::shared_ptr<IncludeStatement> ParseIncludeStatement();
+    std::shared_ptr<VoiceStatement> ParseVoiceStatement();
+    std::shared_ptr<YieldStatement> ParseYieldStatement();
     std::shared_ptr<Statement> ParseAssignStatement();
     std::shared_ptr<Statement> ParseExpressionStatement();
     std::shared_ptr<Expression> ParseExpression(Precedence precedence);
@@ -60,6 +67,7 @@ class Parser {
     std::shared_ptr<Expression> ParsePrefixExpression();
     std::shared_ptr<Identifier> ParseIdentifier();
     std::shared_ptr<Expression> ParseIntegerLiteral();
+    std::shared_ptr<Expression> ParseFloatLiteral();
     std::shared_ptr<Expression> ParseBoolean();
     std::shared_ptr<Expression> ParseGroupedExpression();
     std::shared_ptr<Expression> ParseIfExpression();
@@ -80,7 +88,8 @@ class Parser {
     std::vector<std::shared_ptr<Identifier>> ParseFunctionParameters();
 
    public:
-    Parser(Lexer l);
+    // Include statements are resolved relative to baseDir.
+    Parser(Lexer l, std::string baseDir = "");
     std::shared_ptr<AstProgram> ParseProgram();
     std::vector<std::string> Errors;
     void RegisterPrefix(TokenType tokenType, PrefixParseFn fn);
@@ -0,0 +1,85 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Collects call counts, inclusive and exclusive time per AST node kind and
+// per source line while it is the current profiler of its thread.
+class Profiler {
+   public:
+    struct Stats {
+        uint64_t Calls = 0;
+        // Seconds, inclusive time counts recursive calls once.
+        double Inclusive = 0;
+        double Exclusive = 0;
+        int Active = 0;
+    };
+
+    // Lines are attributed to mainFile until an included file is entered.
+    Profiler(std::string mainFile = "");
+
+    void Enter(std::string_view kind, int line);
+    void Exit();
+
+    // Switches the file lines are attributed to, returns the previous one.
+    size_t EnterFile(const std::string& file);
+    void LeaveFile(size_t previous);
+
+    // Prints the node kinds and the top hot lines, with their source text.
+    void Report(std::ostream& out, size_t top = 20) const;
+
+    std::map<std::string, Stats, std::less<>> Kinds;
+    // Keyed by file index and line.
+    std::map<std::pair<size_t, int>, Stats> Lines;
+    std::vector<std::string> Files;
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    struct Frame {
+        Stats* Kind;
+        Stats* Line;
+        Clock::time_point Start;
+        double Children;
+    };
+
+    std::vector<Frame> frames;
+    size_t file = 0;
+};
+
+// The profiler of this thread, nullptr when not profiling. Checked by every
+// node, so it is a plain thread local the compiler can read without a call.
+inline constinit thread_local Profiler* CurrentProfiler = nullptr;
+
+// Counts the node that is evaluated for the lifetime of the scope.
+class ProfileScope {
+   public:
+    ProfileScope(std::string_view kind, int line) : profiler(CurrentProfiler) {
+        if (profiler != nullptr) profiler->Enter(kind, line);
+    }
+    ~ProfileScope() {
+        if (profiler != nullptr) profiler->Exit();
+    }
+
+   private:
+    Profiler* profiler;
+};
+
+// Attributes lines to an included file for the lifetime of the scope.
+class ProfileFileScope {
+   public:
+    ProfileFileScope(const std::string& file) : profiler(CurrentProfiler) {
+        if (profiler != nullptr) previous = profiler->EnterFile(file);
+    }
+    ~ProfileFileScope() {
+        if (profiler != nullptr) profiler->LeaveFile(previous);
+    }
+
+   private:
+    Profiler* profiler;
+    size_t previous = 0;
+};
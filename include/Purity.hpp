@@ -0,0 +1,12 @@
+#pragma once
+#include <memory>
+
+struct Function;
+
+// Whether calls of function only read the enviroment they were defined in and
+// the objects they are given, so several may run at once on other threads.
+// Conservative: a function is pure when every name it binds is its own, it
+// assigns no indices, and it only calls pure functions, the builtins range,
+// int, float, scale, chord and euclid, and Type. Names are resolved in the
+// enviroment of function as it is now.
+bool IsPure(const std::shared_ptr<Function>& function);
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// xoshiro256**, small and fast enough to call from every inner loop of a
+// script. Each Interpreter owns one, so runs never share a sequence.
+class Xoshiro256 {
+   public:
+    using result_type = uint64_t;
+
+    Xoshiro256(uint64_t seed = 0) { this->seed(seed); }
+
+    // Fills the state from seed with splitmix64, so similar seeds still give
+    // unrelated sequences.
+    void seed(uint64_t seed);
+
+    uint64_t operator()() {
+        uint64_t result = Rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = Rotl(state[3], 45);
+        return result;
+    }
+
+    // A uniform number in [0, n) for n > 0, without modulo bias (Lemire's
+    // multiply and reject).
+    uint64_t Below(uint64_t n) {
+        uint64_t low;
+        uint64_t high = MulHigh((*this)(), n, low);
+        if (low < n) {
+            uint64_t threshold = (0 - n) % n;
+            while (low < threshold) {
+                high = MulHigh((*this)(), n, low);
+            }
+        }
+        return high;
+    }
+
+    // A uniform number in [0, 1).
+    double Unit() { return ((*this)() >> 11) * 0x1.0p-53; }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return std::numeric_limits<uint64_t>::max(); }
+
+   private:
+    static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    static uint64_t MulHigh(uint64_t a, uint64_t b, uint64_t& low) {
+#ifdef _MSC_VER
+        uint64_t high;
+        low = _umul128(a, b, &high);
+        return high;
+#else
+        unsigned __int128 product = (unsigned __int128)a * b;
+        low = (uint64_t)product;
+        return (uint64_t)(product >> 64);
+#endif
+    }
+
+    uint64_t state[4];
+};
+
+// Walker's alias table: built once from weights in O(n), then every sample is
+// one uniform index and one coin flip.
+class AliasTable {
+   public:
+    // weights must not be negative and must not all be zero.
+    AliasTable(const std::vector<double>& weights);
+
+    size_t Sample(Xoshiro256& rng) const {
+        size_t i = rng.Below(probability.size());
+        return rng.Unit() < probability[i] ? i : alias[i];
+    }
+
+   private:
+    std::vector<double> probability;
+    std::vector<size_t> alias;
+};
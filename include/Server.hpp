@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+
+#include "Limits.hpp"
+
+// Keeps one process warm and runs render jobs sent over a unix domain socket
+// at socketPath on a pool of workers threads, each job with its own
+// Interpreter. A job is a block of header lines ended by an empty line:
+//
+//   RUN <path>         run the file at path, or
+//   SOURCE <length>    run the <length> bytes that follow the empty line, at
+//                      most 16 MiB; the connection is closed after an invalid
+//                      length
+//   OUTDIR <dir>       directory relative GenerateMidi names are written to
+//   BASEDIR <dir>      directory includes of SOURCE jobs are resolved against
+//
+// The server answers with "OUT <line>" for every printed line, "ERR <message>"
+// for parse and runtime errors, with backslashes and line breaks written as
+// \\, \n and \r, and "DONE <exit code>" when the job is done.
+// A connection can send any number of jobs one after the other. Jobs of all
+// connections wait for the same workers, an idle connection holds none. Every
+// job is held to limits.
+int Serve(const std::string& socketPath, size_t workers, const RunLimits& limits = {});
+
+// Sends fileName as a RUN job to the server at socketPath and prints its
+// answer. Returns the exit code of the job.
+int SubmitJob(const std::string& socketPath, const std::string& fileName, const std::string& outputDir);
@@ -54,7 +54,10 @@ enum class TokenType {
     RETURN,
     FOR,
     BREAK,
-    IN
+    IN,
+    INCLUDE,
+    VOICE,
+    YIELD
 };
 
 std::string TokenTypeToString(TokenType t);
@@ -0,0 +1,63 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Records spans as Chrome trace events, see chrome://tracing or Perfetto.
+class Tracer {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    Tracer();
+
+    void Add(std::string name, const char* category, Clock::time_point start, Clock::time_point end);
+    bool Write(const std::string& fileName) const;
+
+    // User function calls shorter than this are left out of the trace.
+    std::chrono::microseconds FunctionThreshold = std::chrono::microseconds(100);
+
+   private:
+    struct Event {
+        std::string Name;
+        const char* Category;
+        double Start;
+        double Duration;
+        size_t Thread;
+    };
+
+    Clock::time_point start;
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+    std::vector<std::thread::id> threads;
+};
+
+// The tracer of this thread, nullptr when not tracing.
+inline constinit thread_local Tracer* CurrentTracer = nullptr;
+
+// Records the lifetime of the scope as a span. name must outlive the scope.
+// Spans of the function category are only recorded when they take at least
+// FunctionThreshold.
+class TraceSpan {
+   public:
+    TraceSpan(std::string_view name, const char* category = "interpreter")
+        : tracer(CurrentTracer), name(name), category(category) {
+        if (tracer != nullptr) start = Tracer::Clock::now();
+    }
+    ~TraceSpan() {
+        if (tracer == nullptr) return;
+        auto end = Tracer::Clock::now();
+        if (category == FUNCTION && end - start < tracer->FunctionThreshold) return;
+        tracer->Add(std::string(name), category, start, end);
+    }
+
+    static constexpr const char* FUNCTION = "function";
+
+   private:
+    Tracer* tracer;
+    std::string_view name;
+    const char* category;
+    Tracer::Clock::time_point start;
+};
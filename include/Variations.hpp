@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "Limits.hpp"
+
+struct VariationOptions {
+    size_t Count = 1;
+    // Variation i runs with random seed Seed + i.
+    uint32_t Seed = 0;
+    // Threads to render on, one per core when zero.
+    size_t Workers = 0;
+    // See Interpreter::OutputTemplate.
+    std::string OutputTemplate = "{name}_{i}.midi";
+    RunLimits Limits;
+};
+
+// Parses fileName once and renders options.Count variations of it in
+// parallel, each in its own Interpreter. The output of a variation is printed
+// in one block once it is done, under a line with its index and seed. Returns
+// 1 when any variation failed.
+int RenderVariations(const std::string& fileName, const VariationOptions& options);
@@ -0,0 +1,44 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "Object.hpp"
+
+struct BlockStatement;
+class Env;
+struct Voice;
+
+// The voice running on this thread, nullptr outside of voice blocks.
+inline constinit thread_local Voice* CurrentVoice = nullptr;
+
+// Runs the voices together, each in an enviroment of its own enclosed by env.
+// The voice with the earliest time cursor runs until it moves its cursor past
+// another, so notes are added in the order they start. Once a voice fails the
+// others are stopped and its error or exit is returned.
+std::shared_ptr<IObject> RunVoices(const std::vector<std::shared_ptr<BlockStatement>>& voices, std::shared_ptr<Env> env,
+                                   int line);
+
+// Inside a voice every midi object is at the time of the voice, the time it
+// had when the voices started plus the cursor of the voice. Setting the time
+// of one moves the cursor.
+int VoiceTime(const std::shared_ptr<MidiObj>& midi);
+void SetVoiceTime(const std::shared_ptr<MidiObj>& midi, int time);
+// Lets the voices behind the running one catch up. Returns an error once the
+// voice has to stop because another failed.
+std::shared_ptr<IObject> SwitchVoice();
+
+inline int MidiTime(const std::shared_ptr<MidiObj>& midi) {
+    return CurrentVoice == nullptr ? midi->currentTime : VoiceTime(midi);
+}
+
+inline void SetMidiTime(const std::shared_ptr<MidiObj>& midi, int time) {
+    if (CurrentVoice == nullptr) {
+        midi->currentTime = time;
+    } else {
+        SetVoiceTime(midi, time);
+    }
+}
+
+// Called after moving the time of a midi object, returns nullptr unless the
+// running voice has to stop.
+inline std::shared_ptr<IObject> YieldVoice() { return CurrentVoice == nullptr ? nullptr : SwitchVoice(); }
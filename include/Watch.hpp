@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Ast.hpp"
+
+struct SourceSpan {
+    size_t Start;
+    size_t End;
+    size_t Line;
+};
+
+// Splits source into the spans of its top-level statements using only the
+// lexer, so the spans can be compared without parsing them.
+std::vector<SourceSpan> SplitTopLevel(const std::string& source);
+
+// Keeps the statements of the previous parse keyed by the text of their
+// source span, so an edit only re-parses the top-level statements it touched.
+// Statements that moved to another line are reused with their lines shifted.
+class IncrementalParser {
+   public:
+    // Includes are resolved relative to baseDir.
+    explicit IncrementalParser(std::string baseDir) : baseDir(std::move(baseDir)) {}
+
+    std::shared_ptr<AstProgram> Parse(const std::string& source);
+
+    std::vector<std::string> Errors;
+    size_t Reused = 0;
+    size_t Reparsed = 0;
+    // False when the source has the same statements as the previous parse.
+    bool Changed = true;
+
+   private:
+    std::shared_ptr<AstProgram> ParseAll(const std::string& source);
+
+    // The statements parsed from a span and the line it started on.
+    struct Span {
+        std::vector<std::shared_ptr<Statement>> Statements;
+        size_t Line = 0;
+    };
+
+    std::string baseDir;
+    std::unordered_map<std::string, std::vector<Span>> statements;
+    // The text and line of every span, in order.
+    std::vector<std::pair<std::string, size_t>> order;
+};
+
+// Re-renders fileName every time it or one of its includes changes on disk.
+int Watch(std::string fileName);
@@ -1,23 +1,28 @@
+#include <charconv>
 #include <cstdio>
 #include <cstdlib>
-#include <ctime>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <vector>
 
 #include "Enviroment.hpp"
-#include "Lexer.hpp"
+#include "Interpreter.hpp"
 #include "Object.hpp"
-#include "Parser.hpp"
+#include "Profiler.hpp"
+#include "Trace.hpp"
 #include "Benchmark.hpp"
+#include "Server.hpp"
+#include "Variations.hpp"
+#include "Watch.hpp"
 
 const int FILE_ERROR = 144;
 
 int Repl() {
-    std::shared_ptr<Env> env = std::make_shared<Env>();
-    env->Set("NOTES", make_shared<NoteObj>());
-    env->Set("TIME", make_shared<TimeObj>());
+    Interpreter interpreter;
     std::string line;
     int code = 0;
     while(true) {
@@ -25,16 +30,14 @@ int Repl() {
         std::cout << ">>> ";
         getline(cin, line);
         if (line != "") {
-            Lexer l(line);
-            Parser p(l);
-            auto program = p.ParseProgram();
-            if (!p.Errors.empty()) {
-                for (const auto& err : p.Errors) {
+            auto program = interpreter.Compile(line);
+            if (program == nullptr) {
+                for (const auto& err : interpreter.Errors) {
                     std::cout << err << std::endl;
                 }
                 continue;
             }
-            auto evaluated = program->Evaluate(env);
+            auto evaluated = interpreter.Evaluate(program);
             if (evaluated->Type() == ObjectType::EXIT) {
                 code = static_pointer_cast<ExitObject>(evaluated)->Value;
                 std::cout << "The program exited with code " << code << std::endl;
@@ -48,7 +51,58 @@ int Repl() {
     return code;
 }
 
-int RunFile(std::string fileName) {
+// Flags that change how a file is run.
+struct RunOptions {
+    bool Profile = false;
+    // Where to write the collapsed stacks of --flame.
+    std::string FlameFile;
+    bool AllocStats = false;
+    // Where to write the Chrome trace of --trace.
+    std::string TraceFile;
+    std::chrono::microseconds TraceThreshold = std::chrono::microseconds(100);
+    RunLimits Limits;
+};
+
+// Thrown for a flag whose value is not a number.
+struct ArgumentError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Returns the number after the flag at args[i] and moves i to it. Unlike
+// std::stoul it rejects signs, trailing text and values T can not hold.
+template <typename T>
+T NumberArg(const std::vector<std::string>& args, size_t& i) {
+    const auto& flag = args[i];
+    const auto& text = args[++i];
+    T value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+        throw ArgumentError("'" + text + "' after " + flag + " is not a valid number");
+    }
+    return value;
+}
+
+// Parses the limit flag at args[i] and moves i past its value. Returns false
+// when args[i] is not a limit flag.
+bool ParseLimit(const std::vector<std::string>& args, size_t& i, RunLimits& limits) {
+    if (i + 1 >= args.size()) return false;
+    if (args[i] == "--max-steps") {
+        limits.MaxSteps = NumberArg<uint64_t>(args, i);
+    } else if (args[i] == "--timeout") {
+        limits.Timeout = std::chrono::milliseconds(NumberArg<uint32_t>(args, i));
+    } else if (args[i] == "--max-heap-mb") {
+        limits.MaxHeapBytes = (int64_t)NumberArg<uint32_t>(args, i) * 1024 * 1024;
+    } else if (args[i] == "--max-midi-events") {
+        limits.MaxMidiEvents = NumberArg<size_t>(args, i);
+    } else if (args[i] == "--max-depth") {
+        limits.MaxDepth = NumberArg<size_t>(args, i);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int ReadFile(const std::string& fileName, std::string& fileContent) {
     std::ifstream file(fileName);
     
     if (!file.is_open()) {
@@ -56,7 +110,6 @@ int RunFile(std::string fileName) {
         return FILE_ERROR;
     }
 
-    std::string fileContent;
     fileContent.assign((std::istreambuf_iterator<char>(file)),
                         std::istreambuf_iterator<char>());
     
@@ -70,19 +123,52 @@ int RunFile(std::string fileName) {
         std::cerr << "Error: Failed to close file '" << fileName << "'" << std::endl;
         return FILE_ERROR;
     }
-    
-    Lexer l(fileContent);
-    Parser p(l);
-    auto program = p.ParseProgram();
-    for (const auto& err : p.Errors) {
+    return 0;
+}
+
+int RunFile(std::string fileName, const RunOptions& options = {}) {
+    Tracer tracer;
+    tracer.FunctionThreshold = options.TraceThreshold;
+
+    std::string fileContent;
+    auto readStart = Tracer::Clock::now();
+    int code = ReadFile(fileName, fileContent);
+    if (code != 0) return code;
+    tracer.Add("read", "interpreter", readStart, Tracer::Clock::now());
+
+    Interpreter interpreter;
+    if (!options.TraceFile.empty()) interpreter.Trace = &tracer;
+    auto program = interpreter.Compile(fileContent, std::filesystem::path(fileName).parent_path().string());
+    for (const auto& err : interpreter.Errors) {
         std::cerr << err << std::endl;
         return 1;
     }
 
-    std::shared_ptr<Env> env = std::make_shared<Env>();
-    env->Set("NOTES", make_shared<NoteObj>());
-    env->Set("TIME", make_shared<TimeObj>());
-    auto fin = program->Evaluate(env);
+    Profiler profiler(fileName);
+    if (options.Profile) interpreter.Profile = &profiler;
+    FlameSampler flame(std::filesystem::path(fileName).filename().string());
+    if (!options.FlameFile.empty()) {
+        interpreter.Flame = &flame;
+        flame.Start();
+    }
+
+    AllocStats stats;
+    if (options.AllocStats) interpreter.Stats = &stats;
+    interpreter.Limits = options.Limits;
+
+    auto fin = interpreter.Run(program);
+
+    if (options.Profile) profiler.Report(std::cerr);
+    if (options.AllocStats) stats.Report(std::cerr);
+    if (!options.TraceFile.empty() && !tracer.Write(options.TraceFile)) {
+        std::cerr << "Error: Could not write '" << options.TraceFile << "'" << std::endl;
+    }
+    if (!options.FlameFile.empty()) {
+        flame.Stop();
+        if (!flame.Write(options.FlameFile)) {
+            std::cerr << "Error: Could not write '" << options.FlameFile << "'" << std::endl;
+        }
+    }
 
     if (fin->Type() == ObjectType::EXIT) {
         return static_pointer_cast<ExitObject>(fin)->Value;
@@ -99,14 +185,36 @@ void PrintHelp() {
     std::cout << "Usage: mlang [options] [file]\n";
     std::cout << "Options:\n";
     std::cout << "  --repl           Start the REPL\n";
+    std::cout << "  --watch <file>   Re-render the file every time it changes\n";
+    std::cout << "  --serve <socket> [-j N] [limits]\n";
+    std::cout << "                   Run jobs sent over a unix socket on N workers\n";
+    std::cout << "  --variations <n> [--seed S] [-j T] [--output <template>] [limits] <file>\n";
+    std::cout << "                   Render n variations of the file on T threads, variation i\n";
+    std::cout << "                   with seed S + i, to files named by the template, by default\n";
+    std::cout << "                   {name}_{i}.midi ({seed} is the seed of the variation)\n";
+    std::cout << "  --client <socket> <file> [outdir]\n";
+    std::cout << "                   Send the file as a job to a running server\n";
+    std::cout << "  --benchmark [--filter <text>] [--warmup <n>] [--iterations <n>] [--list]\n";
+    std::cout << "                   Run the interpreter benchmarks, like mlang_bench\n";
+    std::cout << "  --profile <file> Run the file and print where the time went per node and line\n";
+    std::cout << "  --flame <out.folded> <file>\n";
+    std::cout << "                   Run the file and sample its function calls as collapsed stacks\n";
+    std::cout << "  --alloc-stats <file>\n";
+    std::cout << "                   Run the file and print the objects it allocated per type\n";
+    std::cout << "  --trace <out.json> [--trace-threshold <us>] <file>\n";
+    std::cout << "                   Run the file and write a Chrome trace of its phases and of\n";
+    std::cout << "                   function calls taking at least the threshold (default 100)\n";
     std::cout << "  --help           Show this help message\n";
+    std::cout << "Limits, for running a file, every variation or every job of --serve:\n";
+    std::cout << "  --max-steps <n>        Loop iterations plus function calls\n";
+    std::cout << "  --timeout <ms>         Wall clock time of a run\n";
+    std::cout << "  --max-heap-mb <n>      Megabytes of live objects\n";
+    std::cout << "  --max-midi-events <n>  Note events per midi object\n";
+    std::cout << "  --max-depth <n>        Nested function calls, 100000 by default, 0 for as deep as the stack allows\n";
     std::cout << "If no options are provided, the program will attempt to run the specified file.\n";
 }
 
-int main(int argc, char* argv[]) {
-    std::vector<std::string> args(argv + 1, argv + argc);
-    std::srand(std::time(0));
-    
+int Main(const std::vector<std::string>& args) {
     if (args.empty() || args[0] == "--help") {
         return 0;
     }
@@ -115,15 +223,85 @@ int main(int argc, char* argv[]) {
         return Repl();
     }
 
+    if (args[0] == "--watch" && args.size() > 1) {
+        return Watch(args[1]);
+    }
+
+    if (args[0] == "--serve" && args.size() > 1) {
+        size_t workers = 0;
+        RunLimits limits;
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (args[i] == "-j" && i + 1 < args.size()) {
+                workers = NumberArg<size_t>(args, i);
+            } else if (!ParseLimit(args, i, limits)) {
+                PrintHelp();
+                return 1;
+            }
+        }
+        return Serve(args[1], workers, limits);
+    }
+
+    if (args[0] == "--variations" && args.size() > 2) {
+        VariationOptions options;
+        size_t at = 0;
+        options.Count = NumberArg<size_t>(args, at);
+        std::string fileName;
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (args[i] == "--seed" && i + 1 < args.size()) {
+                options.Seed = NumberArg<uint32_t>(args, i);
+            } else if (args[i] == "-j" && i + 1 < args.size()) {
+                options.Workers = NumberArg<size_t>(args, i);
+            } else if (args[i] == "--output" && i + 1 < args.size()) {
+                options.OutputTemplate = args[++i];
+            } else if (!ParseLimit(args, i, options.Limits)) {
+                fileName = args[i];
+            }
+        }
+        return RenderVariations(fileName, options);
+    }
+
+    if (args[0] == "--client" && args.size() > 2) {
+        return SubmitJob(args[1], args[2], args.size() > 3 ? args[3] : "");
+    }
+
     if (args[0] == "--benchmark") {
-        Benchmark(1000000);
-        return 0;
+        return BenchmarkMain(std::vector<std::string>(args.begin() + 1, args.end()));
+    }
+
+    RunOptions options;
+    std::string fileName;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--profile") {
+            options.Profile = true;
+        } else if (args[i] == "--alloc-stats") {
+            options.AllocStats = true;
+        } else if (ParseLimit(args, i, options.Limits)) {
+            continue;
+        } else if (args[i] == "--trace" && i + 1 < args.size()) {
+            options.TraceFile = args[++i];
+        } else if (args[i] == "--trace-threshold" && i + 1 < args.size()) {
+            options.TraceThreshold = std::chrono::microseconds(NumberArg<uint32_t>(args, i));
+        } else if (args[i] == "--flame" && i + 1 < args.size()) {
+            options.FlameFile = args[++i];
+        } else {
+            fileName = args[i];
+        }
     }
 
-    int code = RunFile(args[0]);
+    int code = RunFile(fileName, options);
     if (code == FILE_ERROR) {
         PrintHelp();
     }
 
     return code;
 }
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    try {
+        return Main(args);
+    } catch (const ArgumentError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,108 @@
+#include "AllocStats.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "Enviroment.hpp"
+#include "fmt/core.h"
+
+void CountAllocation(AllocStats* stats, ObjectType type, size_t bytes) {
+    stats->Allocate(stats->Types[(size_t)type], bytes);
+}
+
+void CountFree(AllocStats* stats, ObjectType type, size_t bytes) {
+    stats->Free(stats->Types[(size_t)type], bytes);
+}
+
+void CountOwnedBytes(AllocStats* stats, int64_t bytes) { stats->Charge(bytes); }
+
+void CountEnv(AllocStats* stats, size_t bytes, bool freed) {
+    if (freed) {
+        stats->Free(stats->Envs, bytes);
+    } else {
+        stats->Allocate(stats->Envs, bytes);
+    }
+}
+
+AllocStats::AllocStats() : start(std::chrono::steady_clock::now()) {}
+
+void AllocStats::Allocate(Counts& counts, size_t bytes) {
+    counts.Allocations++;
+    counts.Bytes += bytes;
+    counts.PeakLive = std::max(counts.PeakLive, ++counts.Live);
+    LiveBytes += bytes;
+    PeakLiveBytes = std::max(PeakLiveBytes, LiveBytes);
+}
+
+void AllocStats::Free(Counts& counts, size_t bytes) {
+    counts.Live--;
+    LiveBytes -= bytes;
+}
+
+void AllocStats::Charge(int64_t bytes) {
+    LiveBytes += bytes;
+    PeakLiveBytes = std::max(PeakLiveBytes, LiveBytes);
+}
+
+uint64_t AllocStats::Allocations() const {
+    uint64_t total = Envs.Allocations;
+    for (const auto& counts : Types) {
+        total += counts.Allocations;
+    }
+    return total;
+}
+
+double AllocStats::Rate() const {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() > 0 ? Allocations() / elapsed.count() : 0;
+}
+
+void AllocStats::Report(std::ostream& out) const {
+    auto row = [&](const std::string& name, const Counts& counts) {
+        if (counts.Allocations == 0) return;
+        out << fmt::format("{0:<14} {1:>12} {2:>12} {3:>10} {4:>10}", name, counts.Allocations, counts.Bytes,
+                           counts.Live, counts.PeakLive)
+            << std::endl;
+    };
+
+    out << fmt::format("{0:<14} {1:>12} {2:>12} {3:>10} {4:>10}", "type", "allocations", "bytes", "live", "peak live") << std::endl;
+    for (size_t i = 0; i < Types.size(); ++i) {
+        row(fmt::format("{0}", (ObjectType)i), Types[i]);
+    }
+    row("ENV", Envs);
+    out << fmt::format("{0} allocations, {1:.0f} per second, peak live {2} bytes", Allocations(), Rate(), PeakLiveBytes)
+        << std::endl;
+}
+
+static void Put(std::map<HashKey, HashPair>& pairs, const std::string& key, std::shared_ptr<IObject> value) {
+    auto keyObj = std::make_shared<StringObj>(key);
+    pairs[HashKey(*keyObj)] = HashPair(keyObj, value);
+}
+
+// Integers are 32 bits, counts past them are given as floats.
+template <typename T>
+static std::shared_ptr<IObject> CountValue(T count) {
+    if (std::in_range<int>(count)) return NewInteger(static_cast<int>(count));
+    return NewFloat(static_cast<double>(count));
+}
+
+std::shared_ptr<IObject> AllocStats::ToHash() const {
+    auto counts = [](const Counts& c) {
+        std::map<HashKey, HashPair> pairs;
+        Put(pairs, "allocations", CountValue(c.Allocations));
+        Put(pairs, "bytes", CountValue(c.Bytes));
+        Put(pairs, "live", CountValue(c.Live));
+        Put(pairs, "peak_live", CountValue(c.PeakLive));
+        return std::make_shared<Hash>(pairs);
+    };
+
+    std::map<HashKey, HashPair> pairs;
+    for (size_t i = 0; i < Types.size(); ++i) {
+        if (Types[i].Allocations > 0) Put(pairs, fmt::format("{0}", (ObjectType)i), counts(Types[i]));
+    }
+    Put(pairs, "ENV", counts(Envs));
+    Put(pairs, "allocations", CountValue(Allocations()));
+    Put(pairs, "live_bytes", CountValue(LiveBytes));
+    Put(pairs, "peak_live_bytes", CountValue(PeakLiveBytes));
+    return std::make_shared<Hash>(pairs);
+}
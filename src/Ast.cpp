@@ -1,29 +1,19 @@
 #include "Ast.hpp"
 #include "Enviroment.hpp"
 #include "Evaluator.hpp"
+#include "Iterator.hpp"
+#include "Limits.hpp"
+#include "Module.hpp"
 #include "Object.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Voice.hpp"
 #include "fmt/core.h"
 #include "fmt/format.h"
 
 #include <memory>
 
 
-map<string, std::shared_ptr<IObject>> Builtins = {
-    {"exit", make_shared<BuiltinObj>(ExitCall) },
-    {"range", make_shared<BuiltinObj>(Range) },
-    {"print", make_shared<BuiltinObj>(Print) },
-    {"make_midi", make_shared<BuiltinObj>(MakeMidiObject) },
-    {"random", make_shared<BuiltinObj>(Random) },
-    {"random_seed", make_shared<BuiltinObj>(SetRandomSeed) },
-};
-
-map<string, shared_ptr<IObject>> AccessFunctions {
-    {"Type", make_shared<AccessFuncObj>(Type) },
-    {"AddNote", make_shared<AccessFuncObj>(AddNote) },
-    {"Wait", make_shared<AccessFuncObj>(Wait) },
-    {"GenerateMidi", make_shared<AccessFuncObj>(GenerateMidi) },
-};
-
 std::shared_ptr<IObject> AstProgram::Evaluate(std::shared_ptr<Env> env) {
     shared_ptr<IObject> result = Env::NULLOBJ;
     for (auto& stmt : this->Statements) {
@@ -42,21 +32,29 @@ std::shared_ptr<IObject> AstProgram::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> Identifier::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("Identifier", this->TheToken.LineNumber);
     auto result = env->Get(this->Value);
     if (result != nullptr) {
         return result;
     }
-    if (Builtins.find(this->Value) != Builtins.end()) {
-        return Builtins[this->Value];
+    if (auto builtin = LookupBuiltin(this->Value)) {
+        return builtin;
     }
     return std::make_shared<Error>(fmt::format("at {}, identifier '{}' not found", this->TheToken.LineNumber, this->Value));
 }
 
 std::shared_ptr<IObject> IntegerLiteral::Evaluate(std::shared_ptr<Env> env) {
-    return std::make_shared<Integer>(this->Value);
+    ProfileScope profile("IntegerLiteral", this->TheToken.LineNumber);
+    return NewInteger(this->Value);
+}
+
+std::shared_ptr<IObject> FloatLiteral::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("FloatLiteral", this->TheToken.LineNumber);
+    return this->Value;
 }
 
 std::shared_ptr<IObject> PrefixExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("PrefixExpression", this->TheToken.LineNumber);
     auto preRight = this->Right->Evaluate(env);
     if (IsError(preRight)) return preRight;
 
@@ -64,6 +62,7 @@ std::shared_ptr<IObject> PrefixExpression::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> InfixExpression::Evaluate(std::shared_ptr<Env> env) {
+        ProfileScope profile("InfixExpression", this->TheToken.LineNumber);
         auto inLeft = this->Left->Evaluate(env);
         if (IsError(inLeft)) return inLeft;
 
@@ -74,10 +73,12 @@ std::shared_ptr<IObject> InfixExpression::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> BooleanExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("BooleanExpression", this->TheToken.LineNumber);
     return NativeBoolToBooleanObj(this->Value);
 }
 
 std::shared_ptr<IObject> IndexExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("IndexExpression", this->TheToken.LineNumber);
     auto left = this->Left->Evaluate(env);
     if (IsError(left)) return left;
 
@@ -88,6 +89,7 @@ std::shared_ptr<IObject> IndexExpression::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> CallExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("CallExpression", this->TheToken.LineNumber);
     auto function = this->Function->Evaluate(env);
     if (IsError(function)) return function;
 
@@ -98,17 +100,18 @@ std::shared_ptr<IObject> CallExpression::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> LetStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("LetStatement", this->TheToken.LineNumber);
     auto letVal = this->Value->Evaluate(env);
     if (IsError(letVal)) return letVal;
-    if (Builtins.find(this->Name->Value) != Builtins.end()) {
-        return std::make_shared<Error>(fmt::format("at line: {0}, {1} is a builtin function", this->TheToken.LineNumber, this->Name->Value));
-    }
 
+    // A variable hides a builtin of the same name, as Identifier looks in
+    // the enviroment first, so new builtins never break existing scripts.
     env->Set(this->Name->Value, letVal);
     return Env::NULLOBJ;
 }
 
 std::shared_ptr<IObject> AssignStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("AssignStatement", this->TheToken.LineNumber);
     auto value = this->Value->Evaluate(env);
     if (IsError(value)) return value;
 
@@ -152,10 +155,12 @@ std::shared_ptr<IObject> AssignStatement::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> ExpressionStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("ExpressionStatement", this->TheToken.LineNumber);
     return this->TheExpression->Evaluate(env);
 }
 
 std::shared_ptr<IObject> BlockStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("BlockStatement", this->TheToken.LineNumber);
     shared_ptr<IObject> result = Env::NULLOBJ;
     for (auto& stmt : this->Statements) {
         result = stmt->Evaluate(env);
@@ -168,6 +173,7 @@ std::shared_ptr<IObject> BlockStatement::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> ReturnStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("ReturnStatement", this->TheToken.LineNumber);
     auto retVal = this->Value->Evaluate(env);
     if (IsError(retVal)) return retVal;
 
@@ -175,14 +181,69 @@ std::shared_ptr<IObject> ReturnStatement::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> BreakStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("BreakStatement", this->TheToken.LineNumber);
     return Env::BREAK;
 }
 
+std::shared_ptr<IObject> IncludeStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("IncludeStatement", this->TheToken.LineNumber);
+    std::string path = this->ResolvedPath.empty() ? ResolveModulePath(this->Path, this->BaseDir) : this->ResolvedPath;
+    auto module = ModuleCache::Instance().Load(path, this->TheToken.LineNumber);
+    if (IsError(module)) return module;
+
+    return env->AddEnv(static_pointer_cast<ModuleObj>(module)->Exports);
+}
+
+std::shared_ptr<IObject> YieldStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("YieldStatement", this->TheToken.LineNumber);
+    auto value = this->Value->Evaluate(env);
+    if (IsError(value)) return value;
+
+    auto generator = CurrentGenerator;
+    if (generator == nullptr) {
+        return std::make_shared<Error>(fmt::format("at {0}, yield outside of a generator", this->TheToken.LineNumber));
+    }
+    return generator->Yield(value, this->TheToken.LineNumber);
+}
+
+std::shared_ptr<IObject> VoiceStatement::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("VoiceStatement", this->TheToken.LineNumber);
+    return RunVoices(this->Voices, env, this->TheToken.LineNumber);
+}
+
 std::shared_ptr<IObject> AccessExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("AccessExpression", this->TheToken.LineNumber);
     auto parent = Parent->Evaluate(env);
     if (IsError(parent)) return parent;
-    
-    std::shared_ptr<Env> objEnv = make_shared<Env>(AccessFunctions);
+
+    if (auto stmt = dynamic_pointer_cast<ExpressionStatement>(TheStatement)) {
+        // NOTES->C5 and TIME->QUARTER are constant lookups.
+        if (auto ident = dynamic_pointer_cast<Identifier>(stmt->TheExpression)) {
+            std::shared_ptr<IObject> field = nullptr;
+            if (parent->Type() == ObjectType::NOTE) {
+                field = static_pointer_cast<NoteObj>(parent)->Get(ident->Value);
+            } else if (parent->Type() == ObjectType::TIME) {
+                field = static_pointer_cast<TimeObj>(parent)->Get(ident->Value);
+            }
+            if (field != nullptr) return field;
+        }
+
+        // obj->Function(args) calls the access function without building an
+        // enviroment for the object.
+        if (auto call = dynamic_pointer_cast<CallExpression>(stmt->TheExpression)) {
+            auto name = dynamic_pointer_cast<Identifier>(call->Function);
+            auto function = name != nullptr ? LookupAccessFunction(name->Value) : nullptr;
+            if (function != nullptr) {
+                ProfileScope profile(name->Value, this->TheToken.LineNumber);
+                auto callArgs = EvalExpressions(call->Arguments, env);
+                if (callArgs.size() == 1 && IsError(callArgs[0])) return callArgs[0];
+
+                return static_pointer_cast<AccessFuncObj>(function)->Function(parent, callArgs);
+            }
+        }
+    }
+
+    std::shared_ptr<Env> objEnv = make_shared<Env>(AccessFunctionFields());
     objEnv->Set("_this", parent);
 
     if (auto stmt = dynamic_pointer_cast<ExpressionStatement>(TheStatement)) {
@@ -192,15 +253,16 @@ std::shared_ptr<IObject> AccessExpression::Evaluate(std::shared_ptr<Env> env) {
     }
 
     if (parent->Type() == ObjectType::NOTE) {
-        objEnv->ExtendEnv(static_pointer_cast<NoteObj>(parent)->Fields);
+        objEnv->ExtendEnv(NoteObj::Fields());
     } else if (parent->Type() == ObjectType::TIME) {
-        objEnv->ExtendEnv(static_pointer_cast<TimeObj>(parent)->Fields);
+        objEnv->ExtendEnv(TimeObj::Fields());
     }
 
     return TheStatement->Evaluate(objEnv);
 }
 
 std::shared_ptr<IObject> IfExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("IfExpression", this->TheToken.LineNumber);
     auto condition = this->Condition->Evaluate(env);
     if (IsError(condition)) return condition;
 
@@ -218,19 +280,43 @@ std::shared_ptr<IObject> ForIterative::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> ForExpression::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("ForExpression", this->TheToken.LineNumber);
     auto array = this->Iterative->Evaluate(env);
     if (auto arrayObj = dynamic_pointer_cast<ArrayObject>(array)) {
         for (size_t i = 0; i < arrayObj->Elements.size(); ++i) {
+            if (auto exceeded = CheckBudget(this->TheToken.LineNumber)) return exceeded;
             env->Set(this->Iterative->Index->Value, arrayObj->Elements[i]);
             auto res = this->Body->Evaluate(env);
             if (res->Type() == ObjectType::BREAK) break;
+            if (res->Type() == ObjectType::RETURN_VALUE || IsError(res)) return res;
         }
         env->Remove(this->Iterative->Index->Value);
     } else if (auto iter = dynamic_pointer_cast<IterObj>(array)) {
         for (int i = iter->Low; i < iter->High; i += iter->Steps) {
-            env->Set(this->Iterative->Index->Value, make_shared<Integer>(i));
+            if (auto exceeded = CheckBudget(this->TheToken.LineNumber)) return exceeded;
+            env->Set(this->Iterative->Index->Value, NewInteger(i));
+            auto res = this->Body->Evaluate(env);
+            if (res->Type() == ObjectType::BREAK) break;
+            if (res->Type() == ObjectType::RETURN_VALUE || IsError(res)) return res;
+        }
+        env->Remove(this->Iterative->Index->Value);
+    } else if (auto iterable = Iterate(array)) {
+        // An iterator changes as it is read, another thread may read it too.
+        if (InParallelWorker && array->Type() == ObjectType::ITERATOR) {
+            return std::make_shared<Error>(fmt::format("at {0}, iterators can not be read inside a parallel map or filter",
+                                                       this->TheToken.LineNumber));
+        }
+        // Taken one value at a time, so generators can be endless.
+        auto iterator = dynamic_pointer_cast<IIterator>(iterable);
+        while (true) {
+            if (auto exceeded = CheckBudget(this->TheToken.LineNumber)) return exceeded;
+            auto value = iterator->Next();
+            if (value == nullptr) break;
+            if (IsError(value) || value->Type() == ObjectType::EXIT) return value;
+            env->Set(this->Iterative->Index->Value, value);
             auto res = this->Body->Evaluate(env);
             if (res->Type() == ObjectType::BREAK) break;
+            if (res->Type() == ObjectType::RETURN_VALUE || IsError(res)) return res;
         }
         env->Remove(this->Iterative->Index->Value);
     } else {
@@ -241,15 +327,20 @@ std::shared_ptr<IObject> ForExpression::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> FunctionLiteral::Evaluate(std::shared_ptr<Env> env) {
-    env->Set(this->Ident->Value, make_shared<Function>(this->Parameters, this->Body, env));
+    ProfileScope profile("FunctionLiteral", this->TheToken.LineNumber);
+    auto function = make_shared<Function>(this->Ident, this->Parameters, this->Body, env);
+    function->IsGenerator = this->IsGenerator;
+    env->Set(this->Ident->Value, function);
     return Env::NULLOBJ;
 }
 
 std::shared_ptr<IObject> StringLiteral::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("StringLiteral", this->TheToken.LineNumber);
     return make_shared<StringObj>(this->Value);
 }
 
 std::shared_ptr<IObject> ArrayLiteral::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("ArrayLiteral", this->TheToken.LineNumber);
     auto elements = EvalExpressions(this->Elements, env);
     if (elements.size() == 1 && IsError(elements[0])) return elements[0];
 
@@ -257,6 +348,7 @@ std::shared_ptr<IObject> ArrayLiteral::Evaluate(std::shared_ptr<Env> env) {
 }
 
 std::shared_ptr<IObject> HashLiteral::Evaluate(std::shared_ptr<Env> env) {
+    ProfileScope profile("HashLiteral", this->TheToken.LineNumber);
     map<HashKey, HashPair> pairs;
     for (const auto& [key, value] : this->Pairs) {
         auto keyObj = key->Evaluate(env);
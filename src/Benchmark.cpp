@@ -1,61 +1,452 @@
 #include "Benchmark.hpp"
-#include <array>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
 
-#include "Lexer.hpp"
-#include "Parser.hpp"
-#include "Enviroment.hpp"
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "Builtins.hpp"
+#include "Interpreter.hpp"
 #include "fmt/core.h"
 
-const size_t NUMBER_OF_RUNS = 25;
-
-void Benchmark(int count) {
-	// NOTE: This is a bad way to benchmark, but I like it :)
-	// Fib the destroyer of worlds
-	std::string fib = "function fib(x) { let a = 0; let b = 1; for (i in range(0, x)) { let c = b; b = a + b; a = c; } return a; } fib("+ std::to_string(count)  + "); ";
-	Run(fib, fmt::format("{0}x fib", count));
-}
-
-void Run(std::string code, std::string name) {
-	double sum = 0;
-	for (size_t i = 0; i < NUMBER_OF_RUNS; ++i) {
-		//std::cout << fmt::format("starting {0}", name) << std::endl;
-		auto start = std::chrono::system_clock::now();
-		RunString(code);
-		auto end = std::chrono::system_clock::now();
-		std::chrono::duration<double> elapsed = end - start;
-		//std::cout << fmt::format("{0} at run {1} took: {2} seconds", name, i + 1, elapsed.count()) << std::endl;
-		sum += elapsed.count();
-	}
-	std::cout << fmt::format("average time for {0} = {1}", name, sum / (double)NUMBER_OF_RUNS) << std::endl;
-}
-
-void RunString(std::string code) {
-	auto pstart = std::chrono::system_clock::now();
-	Lexer l(code);
-	Parser p(l);
-	auto program = p.ParseProgram();
-	if (!p.Errors.empty()) {
-		for (const auto& err : p.Errors) {
-			std::cerr << err << std::endl;
-		}
-		return;
-	}
-	auto pend = std::chrono::system_clock::now();
-	std::chrono::duration<double> pelapsed = pend - pstart;
-	//std::cout << "parsing took: " << pelapsed.count() << " seconds" << std::endl;
-
-	auto estart = std::chrono::system_clock::now();
-	std::shared_ptr<Env> env = std::make_shared<Env>();
-	env->Set("NOTES", make_shared<NoteObj>());
-	env->Set("TIME", make_shared<TimeObj>());
-	auto fin = program->Evaluate(env);
-	if (fin->Type() == ObjectType::ERROR) {
-		std::cerr << fin->Inspect() << std::endl;
-	}
-
-	auto eend = std::chrono::system_clock::now();
-	std::chrono::duration<double> eelapsed = eend - estart;
-	//std::cout << "evaluating took: " << eelapsed.count() << " seconds" << std::endl;
-}
\ No newline at end of file
+// Swallows what the workloads print.
+static std::ostream discard(nullptr);
+
+// Compiles code once; every iteration runs it in a fresh interpreter. A
+// script that does not compile or ends in an error fails the workload.
+static std::function<std::function<void()>()> Script(std::string code) {
+	return [code]() -> std::function<void()> {
+		Interpreter compiler;
+		auto program = compiler.Compile(code);
+		if (program == nullptr) {
+			std::string errors;
+			for (const auto& err : compiler.Errors) {
+				errors += (errors.empty() ? "" : "; ") + err;
+			}
+			return [errors] { throw std::runtime_error(errors); };
+		}
+
+		return [program] {
+			Interpreter interpreter;
+			interpreter.WriteFiles = false;
+			interpreter.Output = &discard;
+			auto fin = interpreter.Run(program);
+			if (fin->Type() == ObjectType::ERROR) {
+				throw std::runtime_error(fin->Inspect());
+			}
+		};
+	};
+}
+
+static std::string LargeSource(size_t functions) {
+	std::string code;
+	for (size_t i = 0; i < functions; ++i) {
+		code += fmt::format("function part{0}(midi, root) {{\n", i);
+		code += "    let notes = [root, root + 2, root + 4, root + 5, root + 7];\n";
+		code += "    let lengths = {\"short\": TIME->EIGHTH, \"long\": TIME->QUARTER};\n";
+		code += "    for (i in range(0, 4)) {\n";
+		code += "        if (i == 2) { midi->AddNote(notes[i], lengths[\"long\"], 100); } else { midi->Wait(TIME->EIGHTH); }\n";
+		code += "    }\n";
+		code += "    return root + 1;\n";
+		code += "}\n";
+	}
+	return code;
+}
+
+const std::vector<Workload>& Workloads() {
+	static const std::vector<Workload> workloads = {
+		{"arithmetic", "iterative fib with integer math", 20000, Script(
+			"function fib(x) { let a = 0; let b = 1; for (i in range(0, x)) { let c = b; b = a + b; a = c; } return a; } fib(20000);")},
+		{"nested_loops", "two nested range loops", 40000, Script(
+			"let sum = 0; for (i in range(0, 200)) { for (j in range(0, 200)) { sum += i * j - j; } }")},
+		// fib(n) makes 2 * fib(n + 1) - 1 calls.
+		{"recursion", "recursive fib(16) function calls", 3193, Script(
+			"function fib(x) { if (x < 2) { return x; } return fib(x - 1) + fib(x - 2); } fib(16);")},
+		{"note_generation", "AddNote and Wait through access expressions", 10000, Script(
+			"let midi = make_midi();"
+			"function play(note, time) { midi->AddNote(note, time, 100); midi->Wait(time); }"
+			"for (i in range(0, 5000)) { play(NOTES->C5, TIME->EIGHTH); midi->AddNote(NOTES->G4, TIME->SIXTEENTH, 90); }")},
+		{"hash_array", "hash writes and reads, array indexing", 6000, Script(
+			"let h = {}; let major = [0, 2, 4, 5, 7, 9, 11];"
+			"for (i in range(0, 2000)) { h[i] = major[i - (i / 7) * 7] + 60; }"
+			"let total = 0; for (i in range(0, 2000)) { total += h[i]; }"
+			"for (i in range(0, 2000)) { let k = h[i]; }")},
+		{"strings", "string concatenation, comparison and string keys", 3000, Script(
+			"let s = \"\"; let names = {\"kick\": 36, \"snare\": 38, \"hat\": 42};"
+			"for (i in range(0, 1000)) { s = s + \"x\"; if (s == \"xxx\") { print(s); } let n = names[\"snare\"]; }")},
+		{"parse_large", "parsing a generated 2000 function source", 2000, [] {
+			std::string code = LargeSource(2000);
+			return std::function<void()>([code] {
+				Interpreter interpreter;
+				interpreter.Compile(code);
+			});
+		}},
+		{"midi_encode", "encoding 20000 notes to a midi file", 40000, [] {
+			auto midi = std::make_shared<MidiObj>();
+			for (int i = 0; i < 20000; ++i) {
+				midi->Notes.push_back(MidiNoteEvent(48 + i % 36, 100, i * 120, true));
+				midi->Notes.push_back(MidiNoteEvent(48 + i % 36, 0, i * 120 + 240, false));
+			}
+			return std::function<void()>([midi] { EncodeMidi(*midi); });
+		}},
+	};
+	return workloads;
+}
+
+double BenchmarkResult::Min() const {
+	return Samples.empty() ? 0 : *std::min_element(Samples.begin(), Samples.end());
+}
+
+double BenchmarkResult::Mean() const {
+	return Samples.empty() ? 0 : std::accumulate(Samples.begin(), Samples.end(), 0.0) / Samples.size();
+}
+
+double BenchmarkResult::Percentile(double p) const {
+	if (Samples.empty()) return 0;
+	std::vector<double> sorted = Samples;
+	std::sort(sorted.begin(), sorted.end());
+	size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+double BenchmarkResult::OpsPerSecond() const {
+	double mean = Mean();
+	return mean > 0 ? Ops / mean : 0;
+}
+
+// ru_maxrss only ever grows over the whole process, so it would report the
+// largest workload run so far. On Linux writing 5 to clear_refs resets the
+// peak to the current resident set instead. Returns false where it can not be
+// reset. Memory earlier workloads freed is handed back first, or it would
+// still count as resident.
+static bool ResetPeakRss() {
+#ifdef __linux__
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+	std::ofstream file("/proc/self/clear_refs");
+	file << "5";
+	file.close();
+	return !file.fail();
+#else
+	return false;
+#endif
+}
+
+// The peak resident set size since the last ResetPeakRss.
+static uint64_t PeakRssKb() {
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.rfind("VmHWM:", 0) == 0) return std::strtoull(line.c_str() + 6, nullptr, 10);
+	}
+	return 0;
+}
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkOptions& options) {
+	std::vector<BenchmarkResult> results;
+	for (const auto& workload : Workloads()) {
+		if (workload.Name.find(options.Filter) == std::string::npos) continue;
+
+		BenchmarkResult result;
+		result.Name = workload.Name;
+		result.Ops = workload.Ops;
+		bool measureRss = ResetPeakRss();
+		try {
+			auto iteration = workload.Prepare();
+			for (size_t i = 0; i < options.Warmup; ++i) {
+				iteration();
+			}
+
+			result.Samples.reserve(options.Iterations);
+			uint64_t allocations = options.Allocations ? options.Allocations() : 0;
+			for (size_t i = 0; i < options.Iterations; ++i) {
+				auto start = std::chrono::steady_clock::now();
+				iteration();
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				result.Samples.push_back(elapsed.count());
+			}
+			if (options.Allocations) {
+				result.Allocations = (options.Allocations() - allocations) / options.Iterations;
+			}
+		} catch (const std::exception& e) {
+			result.Samples.clear();
+			result.Error = e.what();
+		}
+		if (measureRss) result.PeakRssKb = PeakRssKb();
+		results.push_back(result);
+	}
+	return results;
+}
+
+std::string ResultsToJson(const std::vector<BenchmarkResult>& results, size_t iterations) {
+	std::string json = "{\n  \"workloads\": [";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& result = results[i];
+		json += i == 0 ? "\n" : ",\n";
+		json += fmt::format("    {{\"name\": \"{0}\", \"iterations\": {1}, \"ops\": {2}, ", result.Name, iterations, result.Ops);
+		json += fmt::format("\"min\": {0}, \"median\": {1}, \"p99\": {2}, \"ops_per_sec\": {3}, ",
+			result.Min(), result.Percentile(50), result.Percentile(99), result.OpsPerSecond());
+		json += fmt::format("\"allocations\": {0}, \"peak_rss_kb\": {1}, \"samples\": [", result.Allocations, result.PeakRssKb);
+		for (size_t j = 0; j < result.Samples.size(); ++j) {
+			json += (j == 0 ? "" : ", ") + fmt::format("{0}", result.Samples[j]);
+		}
+		json += "]}";
+	}
+	json += "\n  ]\n}\n";
+	return json;
+}
+
+// Just enough json to read back what ResultsToJson writes.
+struct JsonValue {
+	double Number = 0;
+	std::string Text;
+	std::vector<JsonValue> Items;
+	std::map<std::string, JsonValue> Fields;
+};
+
+class JsonReader {
+public:
+	JsonReader(const std::string& json) : json(json) {}
+
+	bool Read(JsonValue& value) {
+		SkipWhitespace();
+		if (pos >= json.size()) return false;
+
+		char c = json[pos];
+		if (c == '{') {
+			pos++;
+			if (Peek('}')) return true;
+			do {
+				JsonValue key;
+				SkipWhitespace();
+				if (pos >= json.size() || json[pos] != '"' || !Read(key) || !Peek(':')) return false;
+				if (!Read(value.Fields[key.Text])) return false;
+			} while (Peek(','));
+			return Peek('}');
+		}
+		if (c == '[') {
+			pos++;
+			if (Peek(']')) return true;
+			do {
+				value.Items.emplace_back();
+				if (!Read(value.Items.back())) return false;
+			} while (Peek(','));
+			return Peek(']');
+		}
+		if (c == '"') {
+			size_t end = json.find('"', pos + 1);
+			if (end == std::string::npos) return false;
+			value.Text = json.substr(pos + 1, end - pos - 1);
+			pos = end + 1;
+			return true;
+		}
+
+		char* end = nullptr;
+		value.Number = std::strtod(json.c_str() + pos, &end);
+		if (end == json.c_str() + pos) return false;
+		pos = end - json.c_str();
+		return true;
+	}
+
+private:
+	void SkipWhitespace() {
+		while (pos < json.size() && std::isspace((unsigned char)json[pos])) pos++;
+	}
+
+	bool Peek(char c) {
+		SkipWhitespace();
+		if (pos < json.size() && json[pos] == c) {
+			pos++;
+			return true;
+		}
+		return false;
+	}
+
+	const std::string& json;
+	size_t pos = 0;
+};
+
+bool ResultsFromJson(const std::string& json, std::vector<BenchmarkResult>& results) {
+	JsonValue root;
+	JsonReader reader(json);
+	if (!reader.Read(root) || root.Fields.count("workloads") == 0) return false;
+
+	for (auto& workload : root.Fields["workloads"].Items) {
+		BenchmarkResult result;
+		result.Name = workload.Fields["name"].Text;
+		result.Ops = (size_t)workload.Fields["ops"].Number;
+		for (const auto& sample : workload.Fields["samples"].Items) {
+			result.Samples.push_back(sample.Number);
+		}
+		result.Allocations = (uint64_t)workload.Fields["allocations"].Number;
+		result.PeakRssKb = (uint64_t)workload.Fields["peak_rss_kb"].Number;
+		results.push_back(result);
+	}
+	return true;
+}
+
+// One sided p value that the samples in b are larger than the samples in a,
+// from the normal approximation of the Mann-Whitney U statistic.
+static double MannWhitney(const std::vector<double>& a, const std::vector<double>& b) {
+	std::vector<std::pair<double, int>> all;
+	for (double x : a) all.push_back({x, 0});
+	for (double x : b) all.push_back({x, 1});
+	std::sort(all.begin(), all.end());
+
+	// Rank sum of b, ties get the average of their ranks.
+	double rankSum = 0;
+	for (size_t i = 0; i < all.size();) {
+		size_t j = i;
+		while (j < all.size() && all[j].first == all[i].first) j++;
+		double rank = (i + j + 1) / 2.0;
+		for (size_t k = i; k < j; ++k) {
+			if (all[k].second == 1) rankSum += rank;
+		}
+		i = j;
+	}
+
+	double n1 = a.size(), n2 = b.size();
+	double u = rankSum - n2 * (n2 + 1) / 2;
+	double mean = n1 * n2 / 2;
+	double deviation = std::sqrt(n1 * n2 * (n1 + n2 + 1) / 12);
+	if (deviation == 0) return 1;
+	double z = (u - mean) / deviation;
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+std::vector<Regression> CompareResults(const std::vector<BenchmarkResult>& baseline,
+                                       const std::vector<BenchmarkResult>& current, double threshold) {
+	std::vector<Regression> regressions;
+	for (const auto& result : current) {
+		auto base = std::find_if(baseline.begin(), baseline.end(), [&](const BenchmarkResult& b) { return b.Name == result.Name; });
+		if (base == baseline.end() || base->Percentile(50) <= 0) continue;
+
+		double change = (result.Percentile(50) / base->Percentile(50) - 1) * 100;
+		double p = MannWhitney(base->Samples, result.Samples);
+		if (change > threshold && p < 0.05) {
+			regressions.push_back(Regression{result.Name, change, p});
+		}
+	}
+	return regressions;
+}
+
+// Parses all of text into value. Unlike std::stoul it rejects signs, trailing
+// text and values T can not hold, and unlike std::stod it never throws.
+template <typename T>
+static bool ParseNumber(const std::string& text, T& value) {
+	auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+	return ec == std::errc() && end == text.data() + text.size();
+}
+
+static void PrintUsage() {
+	std::cout << "Usage: mlang_bench [options]\n";
+	std::cout << "Options:\n";
+	std::cout << "  --filter <text>    Only run workloads whose name contains text\n";
+	std::cout << "  --warmup <n>       Untimed iterations before measuring (default 3)\n";
+	std::cout << "  --iterations <n>   Timed iterations per workload (default 25)\n";
+	std::cout << "  --json <file>      Write the results as json, - for stdout\n";
+	std::cout << "  --compare <file>   Compare against results written with --json\n";
+	std::cout << "  --threshold <pct>  Slowdown of the median that counts as a regression (default 5)\n";
+	std::cout << "  --list             List the workloads\n";
+}
+
+int BenchmarkMain(const std::vector<std::string>& args, std::function<uint64_t()> allocations) {
+	BenchmarkOptions options;
+	options.Allocations = allocations;
+	std::string jsonFile;
+	std::string baselineFile;
+	double threshold = 5;
+	for (size_t i = 0; i < args.size(); ++i) {
+		bool hasValue = i + 1 < args.size();
+		if (args[i] == "--filter" && hasValue) {
+			options.Filter = args[++i];
+		} else if (args[i] == "--warmup" && hasValue && ParseNumber(args[i + 1], options.Warmup)) {
+			++i;
+		} else if (args[i] == "--iterations" && hasValue && ParseNumber(args[i + 1], options.Iterations)) {
+			options.Iterations = std::max<size_t>(1, options.Iterations);
+			++i;
+		} else if (args[i] == "--json" && hasValue) {
+			jsonFile = args[++i];
+		} else if (args[i] == "--compare" && hasValue) {
+			baselineFile = args[++i];
+		} else if (args[i] == "--threshold" && hasValue && ParseNumber(args[i + 1], threshold) && std::isfinite(threshold)) {
+			++i;
+		} else if (args[i] == "--list") {
+			for (const auto& workload : Workloads()) {
+				std::cout << fmt::format("{0:<16} {1}", workload.Name, workload.Description) << std::endl;
+			}
+			return 0;
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	std::vector<BenchmarkResult> baseline;
+	if (!baselineFile.empty()) {
+		std::ifstream file(baselineFile);
+		std::stringstream buffer;
+		buffer << file.rdbuf();
+		if (!file.is_open() || !ResultsFromJson(buffer.str(), baseline)) {
+			std::cerr << "Error: Could not read baseline '" << baselineFile << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	// With json on stdout the table goes to stderr so the output stays parsable.
+	std::ostream& out = jsonFile == "-" ? std::cerr : std::cout;
+	out << fmt::format("{0:<16} {1:>10} {2:>10} {3:>10} {4:>10} {5:>14} {6:>10}", "workload", "min ms", "median ms", "p90 ms", "p99 ms", "ops/sec", "allocs") << std::endl;
+	auto results = RunBenchmarks(options);
+	bool failed = false;
+	for (const auto& result : results) {
+		if (!result.Error.empty()) {
+			out << fmt::format("{0:<16} FAILED: {1}", result.Name, result.Error) << std::endl;
+			failed = true;
+			continue;
+		}
+		out << fmt::format("{0:<16} {1:>10.3f} {2:>10.3f} {3:>10.3f} {4:>10.3f} {5:>14.0f} {6:>10}",
+			result.Name, result.Min() * 1000, result.Percentile(50) * 1000, result.Percentile(90) * 1000,
+			result.Percentile(99) * 1000, result.OpsPerSecond(), result.Allocations) << std::endl;
+	}
+
+	// A failed workload has no timings to write or compare.
+	std::erase_if(results, [](const BenchmarkResult& result) { return !result.Error.empty(); });
+
+	if (jsonFile == "-") {
+		std::cout << ResultsToJson(results, options.Iterations);
+	} else if (!jsonFile.empty()) {
+		std::ofstream file(jsonFile);
+		file << ResultsToJson(results, options.Iterations);
+		if (!file) {
+			std::cerr << "Error: Could not write '" << jsonFile << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	if (baselineFile.empty()) return failed ? 1 : 0;
+
+	for (const auto& result : results) {
+		auto base = std::find_if(baseline.begin(), baseline.end(), [&](const BenchmarkResult& b) { return b.Name == result.Name; });
+		if (base == baseline.end()) continue;
+		out << fmt::format("{0:<16} median {1:+.1f}%, allocations {2} -> {3}", result.Name,
+			(result.Percentile(50) / base->Percentile(50) - 1) * 100, base->Allocations, result.Allocations) << std::endl;
+	}
+	auto regressions = CompareResults(baseline, results, threshold);
+	for (const auto& regression : regressions) {
+		out << fmt::format("REGRESSION {0}: {1:.1f}% slower (p = {2:.4f})", regression.Name, regression.Change, regression.PValue) << std::endl;
+	}
+	if (failed) return 1;
+	return regressions.empty() ? 0 : 2;
+}
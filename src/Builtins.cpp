@@ -1,16 +1,112 @@
 #include "Builtins.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
 #include <fstream>
 #include <ios>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <random>
+#include <utility>
+#include <variant>
 
+#include "AllocStats.hpp"
 #include "Enviroment.hpp"
+#include "Evaluator.hpp"
+#include "Flame.hpp"
+#include "Interpreter.hpp"
+#include "Iterator.hpp"
+#include "Limits.hpp"
 #include "Object.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Purity.hpp"
+#include "Random.hpp"
+#include "Trace.hpp"
+#include "Voice.hpp"
 #include "fmt/core.h"
 
+struct BuiltinEntry {
+    std::string_view Name;
+    BuiltinObj Object;
+};
+
+struct AccessEntry {
+    std::string_view Name;
+    AccessFuncObj Object;
+};
+
+static constinit BuiltinEntry BuiltinTable[] = {
+    {"exit", BuiltinObj(ExitCall)},
+    {"range", BuiltinObj(Range)},
+    {"iter", BuiltinObj(Iter)},
+    {"next", BuiltinObj(NextValue)},
+    {"int", BuiltinObj(ToInteger)},
+    {"float", BuiltinObj(ToFloat)},
+    {"print", BuiltinObj(Print)},
+    {"make_midi", BuiltinObj(MakeMidiObject)},
+    {"random", BuiltinObj(Random)},
+    {"random_seed", BuiltinObj(SetRandomSeed)},
+    {"random_many", BuiltinObj(RandomMany)},
+    {"shuffle", BuiltinObj(Shuffle)},
+    {"weighted_choice", BuiltinObj(WeightedChoice)},
+    {"stats", BuiltinObj(AllocationStats)},
+    {"markov", BuiltinObj(Markov)},
+    {"scale", BuiltinObj(Scale)},
+    {"chord", BuiltinObj(Chord)},
+    {"euclid", BuiltinObj(Euclid)},
+    {"map", BuiltinObj(Map)},
+    {"filter", BuiltinObj(Filter)},
+    {"reduce", BuiltinObj(Reduce)},
+};
+
+static constinit AccessEntry AccessTable[] = {
+    {"Type", AccessFuncObj(Type)},
+    {"AddNote", AccessFuncObj(AddNote)},
+    {"Wait", AccessFuncObj(Wait)},
+    {"GenerateMidi", AccessFuncObj(GenerateMidi)},
+    {"Generate", AccessFuncObj(Generate)},
+    {"Play", AccessFuncObj(Play)},
+    {"Copy", AccessFuncObj(Copy)},
+    {"Transpose", AccessFuncObj(Transpose)},
+    {"ScaleVelocity", AccessFuncObj(ScaleVelocity)},
+    {"Quantize", AccessFuncObj(Quantize)},
+    {"Humanize", AccessFuncObj(Humanize)},
+    {"Stretch", AccessFuncObj(Stretch)},
+    {"Overlay", AccessFuncObj(Overlay)},
+    {"Append", AccessFuncObj(Append)},
+    {"Merge", AccessFuncObj(Merge)},
+    {"Now", AccessFuncObj(Now)},
+    {"NotesAt", AccessFuncObj(NotesAt)},
+    {"NotesInRange", AccessFuncObj(NotesInRange)},
+};
+
+std::shared_ptr<IObject> LookupBuiltin(std::string_view name) {
+    for (auto& entry : BuiltinTable) {
+        if (entry.Name == name) return Immortal<IObject>(entry.Object);
+    }
+    return nullptr;
+}
+
+std::shared_ptr<IObject> LookupAccessFunction(std::string_view name) {
+    for (auto& entry : AccessTable) {
+        if (entry.Name == name) return Immortal<IObject>(entry.Object);
+    }
+    return nullptr;
+}
+
+std::map<std::string, std::shared_ptr<IObject>> AccessFunctionFields() {
+    std::map<std::string, std::shared_ptr<IObject>> fields;
+    for (auto& entry : AccessTable) {
+        fields[std::string(entry.Name)] = Immortal<IObject>(entry.Object);
+    }
+    return fields;
+}
+
 // Builtin Functions:
 std::shared_ptr<IObject> ExitCall(const std::vector<std::shared_ptr<IObject>>& args) {
     int code = 0;
@@ -40,12 +136,60 @@ std::shared_ptr<IObject> Range(const std::vector<std::shared_ptr<IObject>>& args
     return std::make_shared<IterObj>(low, high, step);
 }
 
+std::shared_ptr<IObject> Iter(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    auto iterator = Iterate(args[0]);
+    if (iterator == nullptr) return std::make_shared<Error>(fmt::format("{0} can not be iterated", args[0]->Type()));
+    return iterator;
+}
+
+std::shared_ptr<IObject> NextValue(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    auto iterator = dynamic_pointer_cast<IIterator>(args[0]);
+    if (iterator == nullptr) return std::make_shared<Error>(fmt::format("type mismatch, want ITERATOR got {0}", args[0]->Type()));
+    auto value = iterator->Next();
+    return value != nullptr ? value : Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> ToInteger(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    if (args[0]->Type() == ObjectType::INTEGER) return args[0];
+    if (args[0]->Type() != ObjectType::FLOAT) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER or FLOAT got {0}", args[0]->Type()));
+    }
+
+    double value = std::trunc(static_pointer_cast<FloatObj>(args[0])->Value);
+    if (!(value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max())) {
+        return std::make_shared<Error>(fmt::format("{0} does not fit in an integer", args[0]->Inspect()));
+    }
+    return NewInteger((int)value);
+}
+
+std::shared_ptr<IObject> ToFloat(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    if (args[0]->Type() == ObjectType::FLOAT) return args[0];
+    if (args[0]->Type() != ObjectType::INTEGER) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER or FLOAT got {0}", args[0]->Type()));
+    }
+    return NewFloat(static_pointer_cast<Integer>(args[0])->Value);
+}
+
 std::shared_ptr<IObject> Print(const std::vector<std::shared_ptr<IObject>>& args) {
     if (args.size() != 1) {
         return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
     }
 
-    std::cout << args[0]->Inspect() << std::endl;
+    auto interpreter = Interpreter::Current();
+    std::ostream& out = interpreter != nullptr ? *interpreter->Output : std::cout;
+    out << args[0]->Inspect() << std::endl;
     return Env::NULLOBJ;
 }
 
@@ -53,7 +197,19 @@ std::shared_ptr<IObject> MakeMidiObject(const std::vector<std::shared_ptr<IObjec
     if (args.size() != 0) {
         return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=0", args.size()));
     }
-    return make_shared<MidiObj>();
+
+    auto midi = make_shared<MidiObj>();
+    if (auto interpreter = Interpreter::Current()) {
+        interpreter->Midis.push_back(midi);
+    }
+    return midi;
+}
+
+// The generator of the interpreter running on this thread.
+static Xoshiro256& Rng() {
+    if (auto interpreter = Interpreter::Current()) return interpreter->Rng;
+    static thread_local Xoshiro256 rng(std::random_device{}());
+    return rng;
 }
 
 std::shared_ptr<IObject> Random(const std::vector<std::shared_ptr<IObject>>& args) {
@@ -72,24 +228,108 @@ std::shared_ptr<IObject> Random(const std::vector<std::shared_ptr<IObject>>& arg
             return Env::NULLOBJ;
         }
 
-        return arr->Elements[std::rand() % arr->Elements.size()];
+        return arr->Elements[Rng().Below(arr->Elements.size())];
     }
 
-    // ints
-    if (args[0]->Type() != ObjectType::INTEGER || args[1]->Type() != ObjectType::INTEGER) {
-        return std::make_shared<Error>(fmt::format("type mismatch, want 2x INTEGER got {0}, {1}", args[0]->Type(), args[1]->Type()));
+    // ints, from low up to but not including high like range()
+    if (!IsNumber(*args[0]) || !IsNumber(*args[1])) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want 2x INTEGER or FLOAT got {0}, {1}", args[0]->Type(), args[1]->Type()));
+    }
+    // A float anywhere between them when either is a float.
+    if (args[0]->Type() == ObjectType::FLOAT || args[1]->Type() == ObjectType::FLOAT) {
+        double low = NumberValue(*args[0]);
+        return NewFloat(low + Rng().Unit() * (NumberValue(*args[1]) - low));
     }
 
-    int low = std::static_pointer_cast<Integer>(args[0])->Value;
-    int high = std::static_pointer_cast<Integer>(args[1])->Value;
+    int64_t low = std::static_pointer_cast<Integer>(args[0])->Value;
+    int64_t high = std::static_pointer_cast<Integer>(args[1])->Value;
+    if (low > high) std::swap(low, high);
+    if (low == high) return NewInteger((int)low);
+
+    return NewInteger((int)(low + (int64_t)Rng().Below(high - low)));
+}
+
+std::shared_ptr<IObject> RandomMany(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 2) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=2", args.size()));
+    }
+    if (args[0]->Type() != ObjectType::ARRAY || args[1]->Type() != ObjectType::INTEGER) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want ARRAY, INTEGER got {0}, {1}", args[0]->Type(), args[1]->Type()));
+    }
+
+    const auto& elements = static_pointer_cast<ArrayObject>(args[0])->Elements;
+    int count = static_pointer_cast<Integer>(args[1])->Value;
+    if (count < 0) {
+        return std::make_shared<Error>(fmt::format("count must not be negative, got {0}", count));
+    }
+    if (elements.empty()) return std::make_shared<ArrayObject>();
+    if (auto err = CheckHeap(count, sizeof(std::shared_ptr<IObject>))) return err;
+
+    auto& rng = Rng();
+    std::vector<std::shared_ptr<IObject>> picked(count);
+    for (auto& element : picked) {
+        element = elements[rng.Below(elements.size())];
+    }
+    return std::make_shared<ArrayObject>(std::move(picked));
+}
+
+std::shared_ptr<IObject> Shuffle(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    if (args[0]->Type() != ObjectType::ARRAY) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want ARRAY got {0}", args[0]->Type()));
+    }
+
+    // Fisher-Yates on a copy, the argument is left as it was.
+    auto elements = static_pointer_cast<ArrayObject>(args[0])->Elements;
+    auto& rng = Rng();
+    for (size_t i = elements.size(); i > 1; --i) {
+        std::swap(elements[i - 1], elements[rng.Below(i)]);
+    }
+    return std::make_shared<ArrayObject>(std::move(elements));
+}
 
-    if (low > high) {
-        int temp = low;
-        low = high;
-        high = low;
+std::shared_ptr<IObject> WeightedChoice(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 2 && args.size() != 3) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=2 or 3", args.size()));
+    }
+    if (args[0]->Type() != ObjectType::ARRAY || args[1]->Type() != ObjectType::ARRAY) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want 2x ARRAY got {0}, {1}", args[0]->Type(), args[1]->Type()));
     }
 
-    return std::make_shared<Integer>(std::rand() % high + low);
+    const auto& items = static_pointer_cast<ArrayObject>(args[0])->Elements;
+    const auto& weightObjs = static_pointer_cast<ArrayObject>(args[1])->Elements;
+    if (items.size() != weightObjs.size()) {
+        return std::make_shared<Error>(fmt::format("got {0} items but {1} weights", items.size(), weightObjs.size()));
+    }
+
+    std::vector<double> weights;
+    weights.reserve(weightObjs.size());
+    bool positive = false;
+    for (const auto& weight : weightObjs) {
+        if (!IsNumber(*weight) || !(NumberValue(*weight) >= 0) || std::isinf(NumberValue(*weight))) {
+            return std::make_shared<Error>(fmt::format("weights must be numbers of at least 0, got {0}", weight->Inspect()));
+        }
+        weights.push_back(NumberValue(*weight));
+        positive = positive || weights.back() > 0;
+    }
+    if (!positive) return Env::NULLOBJ;
+
+    AliasTable table(weights);
+    auto& rng = Rng();
+    if (args.size() == 2) return items[table.Sample(rng)];
+
+    if (args[2]->Type() != ObjectType::INTEGER || static_pointer_cast<Integer>(args[2])->Value < 0) {
+        return std::make_shared<Error>(fmt::format("count must be an integer of at least 0, got {0}", args[2]->Inspect()));
+    }
+    int count = static_pointer_cast<Integer>(args[2])->Value;
+    if (auto err = CheckHeap(count, sizeof(std::shared_ptr<IObject>))) return err;
+    std::vector<std::shared_ptr<IObject>> picked(count);
+    for (auto& element : picked) {
+        element = items[table.Sample(rng)];
+    }
+    return std::make_shared<ArrayObject>(std::move(picked));
 }
 
 std::shared_ptr<IObject> SetRandomSeed(const std::vector<std::shared_ptr<IObject>>& args) {
@@ -101,15 +341,371 @@ std::shared_ptr<IObject> SetRandomSeed(const std::vector<std::shared_ptr<IObject
         return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER got {0}", args[0]->Type()));
     }
     
-    std::srand(static_pointer_cast<Integer>(args[0])->Value);
+    Rng().seed((uint64_t)static_pointer_cast<Integer>(args[0])->Value);
     return Env::NULLOBJ;
 }
 
+std::shared_ptr<IObject> Markov(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    if (args[0]->Type() != ObjectType::HASH) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want HASH got {0}", args[0]->Type()));
+    }
+
+    auto markov = std::make_shared<MarkovObj>();
+    auto stateOf = [&](const HashKey& key, const std::shared_ptr<IObject>& value) {
+        auto [it, added] = markov->Index.emplace(key, markov->States.size());
+        if (added) markov->States.push_back(MarkovObj::State{value, {}, nullptr});
+        return it->second;
+    };
+
+    for (const auto& [key, pair] : static_pointer_cast<Hash>(args[0])->Pairs) {
+        if (pair.Value->Type() != ObjectType::HASH) {
+            return std::make_shared<Error>(fmt::format("the next states of {0} must be a HASH of weights, got {1}",
+                                                       pair.Key->Inspect(), pair.Value->Type()));
+        }
+        size_t from = stateOf(key, pair.Key);
+
+        std::vector<size_t> next;
+        std::vector<double> weights;
+        for (const auto& [nextKey, nextPair] : static_pointer_cast<Hash>(pair.Value)->Pairs) {
+            if (nextPair.Value->Type() != ObjectType::INTEGER || static_pointer_cast<Integer>(nextPair.Value)->Value < 0) {
+                return std::make_shared<Error>(fmt::format("weights must be integers of at least 0, got {0}", nextPair.Value->Inspect()));
+            }
+            int weight = static_pointer_cast<Integer>(nextPair.Value)->Value;
+            if (weight == 0) continue;
+            next.push_back(stateOf(nextKey, nextPair.Key));
+            weights.push_back(weight);
+        }
+
+        if (next.empty()) continue;
+        markov->States[from].Next = std::move(next);
+        markov->States[from].Table = std::make_unique<AliasTable>(weights);
+    }
+    return markov;
+}
+
+// Semitones above the root of the notes of a scale or chord.
+struct Intervals {
+    std::string_view Name;
+    std::array<int, 12> Steps;
+    size_t Count;
+};
+
+static constexpr Intervals SCALES[] = {
+    {"major", {0, 2, 4, 5, 7, 9, 11}, 7},
+    {"ionian", {0, 2, 4, 5, 7, 9, 11}, 7},
+    {"dorian", {0, 2, 3, 5, 7, 9, 10}, 7},
+    {"phrygian", {0, 1, 3, 5, 7, 8, 10}, 7},
+    {"lydian", {0, 2, 4, 6, 7, 9, 11}, 7},
+    {"mixolydian", {0, 2, 4, 5, 7, 9, 10}, 7},
+    {"minor", {0, 2, 3, 5, 7, 8, 10}, 7},
+    {"aeolian", {0, 2, 3, 5, 7, 8, 10}, 7},
+    {"locrian", {0, 1, 3, 5, 6, 8, 10}, 7},
+    {"harmonic_minor", {0, 2, 3, 5, 7, 8, 11}, 7},
+    {"melodic_minor", {0, 2, 3, 5, 7, 9, 11}, 7},
+    {"major_pentatonic", {0, 2, 4, 7, 9}, 5},
+    {"minor_pentatonic", {0, 3, 5, 7, 10}, 5},
+    {"blues", {0, 3, 5, 6, 7, 10}, 6},
+    {"whole_tone", {0, 2, 4, 6, 8, 10}, 6},
+    {"chromatic", {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, 12},
+};
+
+static constexpr Intervals CHORDS[] = {
+    {"maj", {0, 4, 7}, 3},
+    {"min", {0, 3, 7}, 3},
+    {"dim", {0, 3, 6}, 3},
+    {"aug", {0, 4, 8}, 3},
+    {"sus2", {0, 2, 7}, 3},
+    {"sus4", {0, 5, 7}, 3},
+    {"6", {0, 4, 7, 9}, 4},
+    {"min6", {0, 3, 7, 9}, 4},
+    {"7", {0, 4, 7, 10}, 4},
+    {"maj7", {0, 4, 7, 11}, 4},
+    {"min7", {0, 3, 7, 10}, 4},
+    {"dim7", {0, 3, 6, 9}, 4},
+    {"min7b5", {0, 3, 6, 10}, 4},
+    {"add9", {0, 4, 7, 14}, 4},
+    {"9", {0, 4, 7, 10, 14}, 5},
+    {"maj9", {0, 4, 7, 11, 14}, 5},
+    {"min9", {0, 3, 7, 10, 14}, 5},
+};
+
+template <size_t N>
+static const Intervals* FindIntervals(const Intervals (&table)[N], std::string_view name) {
+    for (const auto& entry : table) {
+        if (entry.Name == name) return &entry;
+    }
+    return nullptr;
+}
+
+template <size_t N>
+static std::string IntervalNames(const Intervals (&table)[N]) {
+    std::string names;
+    for (const auto& entry : table) {
+        names += names.empty() ? "" : ", ";
+        names += entry.Name;
+    }
+    return names;
+}
+
+// Checks that args are at least required and at most allowed integers, except
+// for the string at position name.
+static std::shared_ptr<IObject> CheckIntegers(const std::vector<std::shared_ptr<IObject>>& args, size_t required,
+                                              size_t allowed, int name = -1) {
+    if (args.size() < required || args.size() > allowed) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want={1} to {2}", args.size(), required, allowed));
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        auto want = (int)i == name ? ObjectType::STRING : ObjectType::INTEGER;
+        if (args[i]->Type() != want) {
+            return std::make_shared<Error>(fmt::format("type mismatch, want {0} for argument {1} got {2}", want, i + 1, args[i]->Type()));
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<IObject> Scale(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckIntegers(args, 2, 3, 1)) return err;
+
+    int root = static_pointer_cast<Integer>(args[0])->Value;
+    const auto& name = static_pointer_cast<StringObj>(args[1])->Value;
+    int octaves = args.size() > 2 ? static_pointer_cast<Integer>(args[2])->Value : 1;
+    auto scale = FindIntervals(SCALES, name);
+    if (scale == nullptr) {
+        return std::make_shared<Error>(fmt::format("unknown scale '{0}', want one of {1}", name, IntervalNames(SCALES)));
+    }
+
+    uint64_t count = (uint64_t)std::max(0, octaves) * scale->Count;
+    if (auto err = CheckHeap(count, sizeof(std::shared_ptr<IObject>))) return err;
+    std::vector<std::shared_ptr<IObject>> notes;
+    notes.reserve(count);
+    for (int octave = 0; octave < octaves; ++octave) {
+        for (size_t i = 0; i < scale->Count; ++i) {
+            notes.push_back(NewInteger(root + octave * 12 + scale->Steps[i]));
+        }
+    }
+    return std::make_shared<ArrayObject>(std::move(notes));
+}
+
+std::shared_ptr<IObject> Chord(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckIntegers(args, 2, 3, 1)) return err;
+
+    int root = static_pointer_cast<Integer>(args[0])->Value;
+    const auto& name = static_pointer_cast<StringObj>(args[1])->Value;
+    int inversion = args.size() > 2 ? static_pointer_cast<Integer>(args[2])->Value : 0;
+    auto chord = FindIntervals(CHORDS, name);
+    if (chord == nullptr) {
+        return std::make_shared<Error>(fmt::format("unknown chord '{0}', want one of {1}", name, IntervalNames(CHORDS)));
+    }
+    if (inversion < 0 || inversion >= (int)chord->Count) {
+        return std::make_shared<Error>(fmt::format("a {0} chord has inversions 0 to {1}, got={2}", name, chord->Count - 1, inversion));
+    }
+
+    // An inversion moves the lowest notes up an octave.
+    std::vector<std::shared_ptr<IObject>> notes;
+    notes.reserve(chord->Count);
+    for (size_t i = inversion; i < chord->Count; ++i) {
+        notes.push_back(NewInteger(root + chord->Steps[i]));
+    }
+    for (int i = 0; i < inversion; ++i) {
+        notes.push_back(NewInteger(root + chord->Steps[i] + 12));
+    }
+    return std::make_shared<ArrayObject>(std::move(notes));
+}
+
+std::shared_ptr<IObject> Euclid(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckIntegers(args, 2, 3)) return err;
+
+    int pulses = static_pointer_cast<Integer>(args[0])->Value;
+    int steps = static_pointer_cast<Integer>(args[1])->Value;
+    int rotation = args.size() > 2 ? static_pointer_cast<Integer>(args[2])->Value : 0;
+    if (steps <= 0 || pulses < 0 || pulses > steps) {
+        return std::make_shared<Error>(fmt::format("want 0 <= pulses <= steps and steps > 0, got pulses={0}, steps={1}", pulses, steps));
+    }
+
+    // Step i is a pulse when the running total i * pulses wraps around, which
+    // spreads the pulses as evenly as Bjorklund's algorithm does.
+    if (auto err = CheckHeap(steps, sizeof(std::shared_ptr<IObject>))) return err;
+    std::vector<std::shared_ptr<IObject>> pattern(steps);
+    rotation = ((rotation % steps) + steps) % steps;
+    for (int i = 0; i < steps; ++i) {
+        int step = (i + rotation) % steps;
+        pattern[i] = NewInteger((int64_t)step * pulses % steps < pulses ? 1 : 0);
+    }
+    return std::make_shared<ArrayObject>(std::move(pattern));
+}
+
+// Below this many elements starting the pool costs more than it saves. The
+// first parallel call also makes every reference count of the process atomic.
+const size_t PARALLEL_MIN_ELEMENTS = 2048;
+const size_t PARALLEL_CHUNK = 64;
+
+// Checks that args are an array or range and a function taking arity
+// arguments, followed by extra more.
+static std::shared_ptr<IObject> CheckArrayCall(const std::vector<std::shared_ptr<IObject>>& args, size_t arity,
+                                               size_t extra = 0) {
+    if (args.size() != 2 + extra) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want={1}", args.size(), 2 + extra));
+    }
+    if (args[0]->Type() != ObjectType::ARRAY && args[0]->Type() != ObjectType::ITER) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want ARRAY or ITER for argument 1 got {0}", args[0]->Type()));
+    }
+    if (auto function = dynamic_pointer_cast<Function>(args[1])) {
+        if (function->Parameters.size() != arity) {
+            return std::make_shared<Error>(fmt::format("function {0} takes {1} arguments, want {2}", function->Name->Value,
+                                                       function->Parameters.size(), arity));
+        }
+    } else if (dynamic_pointer_cast<BuiltinObj>(args[1]) == nullptr) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want FUNCTION for argument 2 got {0}", args[1]->Type()));
+    }
+    // A range is made into an array, next to the results of map and filter.
+    if (args[0]->Type() == ObjectType::ITER) {
+        auto& range = static_cast<IterObj&>(*args[0]);
+        int64_t length = range.Steps > 0 && range.Low < range.High
+                             ? ((int64_t)range.High - range.Low + range.Steps - 1) / range.Steps
+                             : 0;
+        return CheckHeap(2 * length, sizeof(std::shared_ptr<IObject>));
+    }
+    return nullptr;
+}
+
+// Whether calls of function over count elements are worth spreading over the
+// pool, and can be: the function is pure and nothing on this thread limits,
+// counts or times the run, as those only see the calling thread.
+static bool RunsInParallel(const std::shared_ptr<IObject>& function, size_t count) {
+    if (count < PARALLEL_MIN_ELEMENTS || ParallelThreads() == 1 || InParallelWorker) return false;
+    if (CurrentBudget != nullptr || CurrentAllocStats != nullptr || CurrentProfiler != nullptr || CurrentFlame != nullptr ||
+        CurrentTracer != nullptr) {
+        return false;
+    }
+    auto user = dynamic_pointer_cast<Function>(function);
+    return user != nullptr && IsPure(user);
+}
+
+// The elements of an array, or the values of a range.
+static std::shared_ptr<ArrayObject> ElementsOf(const std::shared_ptr<IObject>& obj) {
+    if (obj->Type() == ObjectType::ARRAY) return static_pointer_cast<ArrayObject>(obj);
+    auto range = static_pointer_cast<IterObj>(obj);
+    std::vector<std::shared_ptr<IObject>> values;
+    for (int i = range->Low; range->Steps > 0 && i < range->High; i += range->Steps) values.push_back(NewInteger(i));
+    return std::make_shared<ArrayObject>(std::move(values));
+}
+
+static bool Stops(const std::shared_ptr<IObject>& result) {
+    return IsError(result) || result->Type() == ObjectType::EXIT;
+}
+
+// Calls function on every element into results, stopping at the first error or
+// exit, whose index is returned, or the count when there is none.
+static size_t ApplyEach(const std::shared_ptr<IObject>& function, const std::vector<std::shared_ptr<IObject>>& elements,
+                        std::vector<std::shared_ptr<IObject>>& results) {
+    results.resize(elements.size());
+    auto serial = [&] {
+        for (size_t i = 0; i < elements.size(); ++i) {
+            results[i] = ApplyFunction(function, {elements[i]}, nullptr, 0);
+            if (Stops(results[i])) return i;
+        }
+        return elements.size();
+    };
+    if (!RunsInParallel(function, elements.size())) return serial();
+
+    // Indices past a failed one are skipped, every one before it still runs
+    // so the first failure is the one a serial run would stop at.
+    std::atomic<size_t> failed = elements.size();
+    bool parallel = ParallelFor(elements.size(), PARALLEL_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && i < failed.load(std::memory_order_relaxed); ++i) {
+            results[i] = ApplyFunction(function, {elements[i]}, nullptr, 0);
+            if (!Stops(results[i])) continue;
+            for (size_t first = failed.load(); i < first && !failed.compare_exchange_weak(first, i);) {
+            }
+        }
+    });
+    return parallel ? failed.load() : serial();
+}
+
+std::shared_ptr<IObject> Map(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckArrayCall(args, 1)) return err;
+
+    std::vector<std::shared_ptr<IObject>> results;
+    size_t failed = ApplyEach(args[1], ElementsOf(args[0])->Elements, results);
+    if (failed < results.size()) return results[failed];
+    return std::make_shared<ArrayObject>(std::move(results));
+}
+
+std::shared_ptr<IObject> Filter(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckArrayCall(args, 1)) return err;
+
+    auto array = ElementsOf(args[0]);
+    const auto& elements = array->Elements;
+    std::vector<std::shared_ptr<IObject>> keep;
+    size_t failed = ApplyEach(args[1], elements, keep);
+    if (failed < keep.size()) return keep[failed];
+
+    std::vector<std::shared_ptr<IObject>> kept;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        if (IsTruthy(keep[i])) kept.push_back(elements[i]);
+    }
+    return std::make_shared<ArrayObject>(std::move(kept));
+}
+
+std::shared_ptr<IObject> Reduce(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckArrayCall(args, 2, 1)) return err;
+
+    // Serial, splitting would need the function to be associative.
+    auto accumulated = args[2];
+    for (const auto& element : ElementsOf(args[0])->Elements) {
+        accumulated = ApplyFunction(args[1], {accumulated, element}, nullptr, 0);
+        if (Stops(accumulated)) return accumulated;
+    }
+    return accumulated;
+}
+
+std::shared_ptr<IObject> AllocationStats(const std::vector<std::shared_ptr<IObject>>& args) {
+    if (args.size() != 0) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=0", args.size()));
+    }
+
+    auto interpreter = Interpreter::Current();
+    if (interpreter == nullptr || interpreter->Stats == nullptr) {
+        return std::make_shared<Error>("allocations are not counted, run with --alloc-stats");
+    }
+    return interpreter->Stats->ToHash();
+}
+
 // Access Function:
 std::shared_ptr<IObject> Type(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
     return make_shared<StringObj>(fmt::format("{0}", self->Type()));
 }
 
+// Adds the on and off events of a note to midi, or returns an error.
+static std::shared_ptr<IObject> AddNoteEvents(const std::shared_ptr<MidiObj>& midi, int note, int time, int velocity) {
+    if (note < 0 || note > 127) {
+        return std::make_shared<Error>(fmt::format("the value of a note must be between 0 and 127, got={0}", note));
+    }
+
+    if (velocity < 0 || velocity > 127) {
+        return std::make_shared<Error>(fmt::format("the value of a velocity must be between 0 and 127, got={0}", velocity));
+    }
+
+    if (time <= 0) {
+        return std::make_shared<Error>(fmt::format("the time of a note must be more than 0, got={0}", time));
+    }
+
+    auto budget = CurrentBudget;
+    if (budget != nullptr && budget->Limits.MaxMidiEvents != 0 && midi->Notes.size() + 2 > budget->Limits.MaxMidiEvents) {
+        return std::make_shared<Error>(fmt::format("exceeded the limit of {0} midi events", budget->Limits.MaxMidiEvents));
+    }
+
+    int note_duration_tick = TICKS_PER_QUARTER * 4 / time;
+
+    int now = MidiTime(midi);
+    midi->Notes.push_back(MidiNoteEvent(note, velocity, now, true));
+    midi->Notes.push_back(MidiNoteEvent(note, 0, now + note_duration_tick, false));
+    return nullptr;
+}
+
 std::shared_ptr<IObject> AddNote(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
     if (self->Type() != ObjectType::MIDI) {
         return std::make_shared<Error>(fmt::format("{} doesn't have the function AddNote", self->Type()));
@@ -127,19 +723,7 @@ std::shared_ptr<IObject> AddNote(std::shared_ptr<IObject> self, const std::vecto
     int note = static_pointer_cast<Integer>(args[0])->Value;
     int time = static_pointer_cast<Integer>(args[1])->Value;
     int velocity = static_pointer_cast<Integer>(args[2])->Value;
-
-    if (note < 0 || note > 127) {
-        return std::make_shared<Error>(fmt::format("the value of a note must be between 0 and 127, got={0}", note));
-    }
-
-    if (velocity < 0 || velocity > 127) {
-        return std::make_shared<Error>(fmt::format("the value of a velocity must be between 0 and 127, got={0}", velocity));
-    }
-
-    int note_duration_tick = TICKS_PER_QUARTER * 4 / time;
-
-    midi->Notes.push_back(MidiNoteEvent(note, velocity, midi->currentTime, true));
-    midi->Notes.push_back(MidiNoteEvent(note, 0, midi->currentTime + note_duration_tick, false));
+    if (auto err = AddNoteEvents(midi, note, time, velocity)) return err;
 
     return Env::NULLOBJ;
 }
@@ -157,57 +741,364 @@ std::shared_ptr<IObject> Wait(std::shared_ptr<IObject> self, const std::vector<s
         return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER got {0}", args[0]->Type()));
     }
 
+    int time = static_pointer_cast<Integer>(args[0])->Value;
+    if (time <= 0) {
+        return std::make_shared<Error>(fmt::format("the time to wait must be more than 0, got={0}", time));
+    }
+
     auto midi = static_pointer_cast<MidiObj>(self);
-    midi->currentTime += 480 * 4 / static_pointer_cast<Integer>(args[0])->Value;
+    SetMidiTime(midi, MidiTime(midi) + 480 * 4 / time);
+    if (auto stopped = YieldVoice()) return stopped;
     return Env::NULLOBJ;
 }
 
-void write_big_endian(std::ofstream& file, uint32_t value, size_t byte_count) {
-    for (int i = (byte_count - 1) * 8; i >= 0; i -= 8) {
-        file.put(static_cast<unsigned char>((value >> i) & 0xFF));
+// The index of the state start of markov, or an error.
+static std::variant<size_t, std::shared_ptr<IObject>> MarkovStart(MarkovObj& markov, const std::shared_ptr<IObject>& start) {
+    auto hashable = dynamic_pointer_cast<IHashable>(start);
+    if (hashable == nullptr) return std::make_shared<Error>(fmt::format("unusable as a markov state: {0}", start->Type()));
+    auto it = markov.Index.find(hashable->GetHashKey());
+    if (it == markov.Index.end()) return std::make_shared<Error>(fmt::format("{0} is not a state of the markov chain", start->Inspect()));
+    return it->second;
+}
+
+// A chain can end in a state with no way out long before the count asked for,
+// so Generate reserves at most this many states up front.
+const int GENERATE_RESERVE = 4096;
+
+std::shared_ptr<IObject> Generate(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (self->Type() != ObjectType::MARKOV) {
+        return std::make_shared<Error>(fmt::format("{} doesn't have the function Generate", self->Type()));
+    }
+    if (args.size() != 2) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=2", args.size()));
+    }
+    if (args[1]->Type() != ObjectType::INTEGER) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER got {0}", args[1]->Type()));
     }
+
+    auto& markov = *static_pointer_cast<MarkovObj>(self);
+    auto start = MarkovStart(markov, args[0]);
+    if (auto err = std::get_if<std::shared_ptr<IObject>>(&start)) return *err;
+
+    int64_t state = std::get<size_t>(start);
+    int count = std::max(0, static_pointer_cast<Integer>(args[1])->Value);
+    auto& rng = Rng();
+    std::vector<std::shared_ptr<IObject>> states;
+    states.reserve(std::min(count, GENERATE_RESERVE));
+    for (int i = 0; i < count; ++i) {
+        state = markov.Step(state, rng);
+        if (state < 0) break;
+        // Growing doubles the states, the heap limit is checked before.
+        if (states.size() == states.capacity()) {
+            if (auto err = CheckHeap(states.size(), sizeof(std::shared_ptr<IObject>))) return err;
+        }
+        states.push_back(markov.States[state].Value);
+    }
+    return std::make_shared<ArrayObject>(std::move(states));
 }
 
-std::shared_ptr<IObject> GenerateMidi(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+std::shared_ptr<IObject> Play(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (self->Type() != ObjectType::MARKOV) {
+        return std::make_shared<Error>(fmt::format("{} doesn't have the function Play", self->Type()));
+    }
+    if (args.size() != 5) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=5", args.size()));
+    }
+    if (args[0]->Type() != ObjectType::MIDI || args[2]->Type() != ObjectType::INTEGER ||
+        args[3]->Type() != ObjectType::INTEGER || args[4]->Type() != ObjectType::INTEGER) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want MIDI, state, 3x INTEGER got {0}, {1}, {2}, {3}, {4}",
+                                                   args[0]->Type(), args[1]->Type(), args[2]->Type(), args[3]->Type(), args[4]->Type()));
+    }
+
+    auto& markov = *static_pointer_cast<MarkovObj>(self);
+    auto start = MarkovStart(markov, args[1]);
+    if (auto err = std::get_if<std::shared_ptr<IObject>>(&start)) return *err;
+
+    auto midi = static_pointer_cast<MidiObj>(args[0]);
+    int count = static_pointer_cast<Integer>(args[2])->Value;
+    int time = static_pointer_cast<Integer>(args[3])->Value;
+    int velocity = static_pointer_cast<Integer>(args[4])->Value;
+    if (time <= 0) {
+        return std::make_shared<Error>(fmt::format("the time of a note must be more than 0, got={0}", time));
+    }
+
+    int64_t state = std::get<size_t>(start);
+    auto& rng = Rng();
+    for (int i = 0; i < count; ++i) {
+        int64_t next = markov.Step(state, rng);
+        if (next < 0) break;
+        state = next;
+
+        const auto& value = markov.States[state].Value;
+        if (value->Type() != ObjectType::INTEGER) {
+            return std::make_shared<Error>(fmt::format("type mismatch, only INTEGER states can be played, got {0}", value->Type()));
+        }
+        if (auto err = AddNoteEvents(midi, static_pointer_cast<Integer>(value)->Value, time, velocity)) return err;
+        SetMidiTime(midi, MidiTime(midi) + TICKS_PER_QUARTER * 4 / time);
+        if (auto stopped = YieldVoice()) return stopped;
+    }
+    return markov.States[state].Value;
+}
+
+// Returns an error unless self is a midi object and args are at least
+// required and at most allowed integers.
+static std::shared_ptr<IObject> CheckMidiCall(const char* function, const std::shared_ptr<IObject>& self,
+                                              const std::vector<std::shared_ptr<IObject>>& args, size_t required,
+                                              size_t allowed) {
     if (self->Type() != ObjectType::MIDI) {
-        return std::make_shared<Error>(fmt::format("{} doesn't have the function GenerateMidi", self->Type()));
+        return std::make_shared<Error>(fmt::format("{0} doesn't have the function {1}", self->Type(), function));
+    }
+    return CheckIntegers(args, required, allowed);
+}
+
+static int IntArg(const std::vector<std::shared_ptr<IObject>>& args, size_t i) {
+    return static_pointer_cast<Integer>(args[i])->Value;
+}
+
+static int Clamp127(int64_t value) { return (int)std::clamp<int64_t>(value, 0, 127); }
+
+std::shared_ptr<IObject> Copy(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("Copy", self, args, 0, 0)) return err;
+    if (auto err = CheckHeap(static_pointer_cast<MidiObj>(self)->Notes.size(), sizeof(MidiNoteEvent))) return err;
+
+    auto copy = std::make_shared<MidiObj>(*static_pointer_cast<MidiObj>(self));
+    if (auto interpreter = Interpreter::Current()) {
+        interpreter->Midis.push_back(copy);
+    }
+    return copy;
+}
+
+std::shared_ptr<IObject> Transpose(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("Transpose", self, args, 1, 1)) return err;
+
+    int semitones = IntArg(args, 0);
+    for (auto& event : static_pointer_cast<MidiObj>(self)->Notes) {
+        event.Note = Clamp127((int64_t)event.Note + semitones);
+    }
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> ScaleVelocity(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("ScaleVelocity", self, args, 1, 1)) return err;
+
+    // Off events have velocity 0 and stay that way.
+    int64_t percent = IntArg(args, 0);
+    for (auto& event : static_pointer_cast<MidiObj>(self)->Notes) {
+        event.Velocity = Clamp127(event.Velocity * percent / 100);
+    }
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> Quantize(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("Quantize", self, args, 1, 1)) return err;
+
+    int grid = IntArg(args, 0);
+    if (grid <= 0) {
+        return std::make_shared<Error>(fmt::format("the grid must be a time like TIME->SIXTEENTH, got={0}", grid));
     }
 
+    // Notes start on the nearest grid line and keep their length.
+    int64_t ticks = std::max(1, TICKS_PER_QUARTER * 4 / grid);
+    auto& notes = static_pointer_cast<MidiObj>(self)->Notes;
+    for (size_t i = 0; i + 1 < notes.size(); i += 2) {
+        int64_t start = notes[i].Time;
+        int64_t shift = (start + ticks / 2) / ticks * ticks - start;
+        notes[i].Time += shift;
+        notes[i + 1].Time += shift;
+    }
+    static_pointer_cast<MidiObj>(self)->Index.Invalidate();
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> Humanize(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("Humanize", self, args, 1, 2)) return err;
+
+    int64_t ticks = IntArg(args, 0);
+    if (ticks < 0) {
+        return std::make_shared<Error>(fmt::format("ticks must not be negative, got={0}", ticks));
+    }
+
+    // A seed makes the same piece humanize the same way every time.
+    Xoshiro256 seeded(args.size() > 1 ? (uint64_t)IntArg(args, 1) : 0);
+    auto& rng = args.size() > 1 ? seeded : Rng();
+    auto& notes = static_pointer_cast<MidiObj>(self)->Notes;
+    for (size_t i = 0; i + 1 < notes.size(); i += 2) {
+        int64_t shift = (int64_t)rng.Below(2 * ticks + 1) - ticks;
+        shift = std::max<int64_t>(shift, -(int64_t)notes[i].Time);
+        notes[i].Time += shift;
+        notes[i + 1].Time += shift;
+    }
+    static_pointer_cast<MidiObj>(self)->Index.Invalidate();
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> Stretch(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("Stretch", self, args, 1, 1)) return err;
+
+    int64_t percent = IntArg(args, 0);
+    if (percent <= 0) {
+        return std::make_shared<Error>(fmt::format("the percentage must be more than 0, got={0}", percent));
+    }
+
+    auto midi = static_pointer_cast<MidiObj>(self);
+    for (auto& event : midi->Notes) {
+        event.Time = (uint32_t)(event.Time * percent / 100);
+    }
+    SetMidiTime(midi, (int)(MidiTime(midi) * percent / 100));
+    midi->Index.Invalidate();
+    if (auto stopped = YieldVoice()) return stopped;
+    return Env::NULLOBJ;
+}
+
+// Adds the notes of from to into, offset ticks later. Both keep their notes in
+// the order they were added and are only sorted when encoded, so this is one
+// pass over from however the two interleave in time.
+static std::shared_ptr<IObject> AddNotesOf(const std::shared_ptr<MidiObj>& into, const MidiObj& from, int64_t offset) {
+    auto budget = CurrentBudget;
+    size_t count = from.Notes.size();
+    if (budget != nullptr && budget->Limits.MaxMidiEvents != 0 && into->Notes.size() + count > budget->Limits.MaxMidiEvents) {
+        return std::make_shared<Error>(fmt::format("exceeded the limit of {0} midi events", budget->Limits.MaxMidiEvents));
+    }
+    if (auto err = CheckHeap(count, sizeof(MidiNoteEvent))) return err;
+
+    // Indices, since from may be into.
+    into->Notes.reserve(into->Notes.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        MidiNoteEvent event = from.Notes[i];
+        event.Time += offset;
+        into->Notes.push_back(event);
+    }
+    if (from.currentTime + offset > MidiTime(into)) {
+        SetMidiTime(into, (int)(from.currentTime + offset));
+        return YieldVoice();
+    }
+    return nullptr;
+}
+
+std::shared_ptr<IObject> Overlay(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (self->Type() != ObjectType::MIDI) {
+        return std::make_shared<Error>(fmt::format("{} doesn't have the function Overlay", self->Type()));
+    }
+    if (args.size() != 1 && args.size() != 2) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1 or 2", args.size()));
+    }
+    if (args[0]->Type() != ObjectType::MIDI || (args.size() > 1 && args[1]->Type() != ObjectType::INTEGER)) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want MIDI and an INTEGER offset got {0}", args[0]->Type()));
+    }
+
+    int offset = args.size() > 1 ? IntArg(args, 1) : 0;
+    if (offset < 0) {
+        return std::make_shared<Error>(fmt::format("the offset must not be negative, got={0}", offset));
+    }
+    if (auto err = AddNotesOf(static_pointer_cast<MidiObj>(self), *static_pointer_cast<MidiObj>(args[0]), offset)) return err;
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> Append(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (self->Type() != ObjectType::MIDI) {
+        return std::make_shared<Error>(fmt::format("{} doesn't have the function Append", self->Type()));
+    }
     if (args.size() != 1) {
         return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
     }
+    if (args[0]->Type() != ObjectType::MIDI) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want MIDI got {0}", args[0]->Type()));
+    }
 
-    if (args[0]->Type() != ObjectType::STRING) {
-        return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER got {0}", args[0]->Type()));
+    auto midi = static_pointer_cast<MidiObj>(self);
+    if (auto err = AddNotesOf(midi, *static_pointer_cast<MidiObj>(args[0]), MidiTime(midi))) return err;
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> Merge(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (self->Type() != ObjectType::MIDI) {
+        return std::make_shared<Error>(fmt::format("{} doesn't have the function Merge", self->Type()));
     }
 
+    size_t count = 0;
+    for (const auto& arg : args) {
+        if (arg->Type() != ObjectType::MIDI) {
+            return std::make_shared<Error>(fmt::format("type mismatch, want MIDI got {0}", arg->Type()));
+        }
+        count += static_pointer_cast<MidiObj>(arg)->Notes.size();
+    }
+
+    if (auto err = CheckHeap(count, sizeof(MidiNoteEvent))) return err;
     auto midi = static_pointer_cast<MidiObj>(self);
-    std::string filename = static_pointer_cast<StringObj>(args[0])->Value;
-    std::ofstream file(filename, std::ios::binary);
+    midi->Notes.reserve(midi->Notes.size() + count);
+    for (const auto& arg : args) {
+        if (auto err = AddNotesOf(midi, *static_pointer_cast<MidiObj>(arg), 0)) return err;
+    }
+    return Env::NULLOBJ;
+}
 
-    if (!file.is_open()) {
-        return std::make_shared<Error>(fmt::format("failed to create file with name={0}", filename));
+std::shared_ptr<IObject> Now(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("Now", self, args, 0, 0)) return err;
+    return NewInteger(MidiTime(static_pointer_cast<MidiObj>(self)));
+}
+
+// The note values of the notes of midi sounding in [from, to).
+static std::shared_ptr<IObject> SoundingNotes(MidiObj& midi, int64_t from, int64_t to) {
+    std::vector<std::shared_ptr<IObject>> values;
+    if (to > 0 && to > from) {
+        for (size_t event : midi.Index.Sounding(midi.Notes, (uint32_t)std::max<int64_t>(from, 0), (uint32_t)to)) {
+            values.push_back(NewInteger(midi.Notes[event].Note));
+        }
     }
+    return std::make_shared<ArrayObject>(std::move(values));
+}
+
+std::shared_ptr<IObject> NotesAt(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("NotesAt", self, args, 0, 1)) return err;
+
+    auto midi = static_pointer_cast<MidiObj>(self);
+    int64_t tick = args.empty() ? MidiTime(midi) : IntArg(args, 0);
+    return SoundingNotes(*midi, tick, tick + 1);
+}
+
+std::shared_ptr<IObject> NotesInRange(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (auto err = CheckMidiCall("NotesInRange", self, args, 2, 2)) return err;
+    return SoundingNotes(*static_pointer_cast<MidiObj>(self), IntArg(args, 0), IntArg(args, 1));
+}
+
+void write_big_endian(std::vector<uint8_t>& data, uint32_t value, size_t byte_count) {
+    for (int i = (byte_count - 1) * 8; i >= 0; i -= 8) {
+        data.push_back(static_cast<uint8_t>((value >> i) & 0xFF));
+    }
+}
+
+std::vector<uint8_t> EncodeMidi(MidiObj& midi) {
+    std::vector<uint8_t> data;
 
     // Write midi header
-    file.write("MThd", 4);
-    write_big_endian(file, 6, 4);    // 4 bytes for header length
-    write_big_endian(file, 1, 2);    // 2 bytes for format type
-    write_big_endian(file, 1, 2);    // 2 bytes for number of tracks
-    write_big_endian(file, 480, 2);  // 2 bytes for time division
-
-    std::sort(midi->Notes.begin(), midi->Notes.end(), [](const MidiNoteEvent& a, const MidiNoteEvent& b) {
-        return a.Time < b.Time;
-    });
+    data.insert(data.end(), {'M', 'T', 'h', 'd'});
+    write_big_endian(data, 6, 4);    // 4 bytes for header length
+    write_big_endian(data, 1, 2);    // 2 bytes for format type
+    write_big_endian(data, 1, 2);    // 2 bytes for number of tracks
+    write_big_endian(data, 480, 2);  // 2 bytes for time division
+
+    // Stable, so a note that ends where the same note starts again is let go
+    // first. Notes added in time order, as voices add them, are often in order
+    // already and are encoded without a copy.
+    auto earlier = [](const MidiNoteEvent& a, const MidiNoteEvent& b) { return a.Time < b.Time; };
+    const std::vector<MidiNoteEvent>* ordered = &midi.Notes;
+    std::vector<MidiNoteEvent> events;
+    if (!std::is_sorted(midi.Notes.begin(), midi.Notes.end(), earlier)) {
+        TraceSpan span("sort");
+        events = midi.Notes;
+        std::stable_sort(events.begin(), events.end(), earlier);
+        ordered = &events;
+    }
 
     // Write track data
-    file.write("MTrk", 4);
+    TraceSpan span("encode");
+    data.insert(data.end(), {'M', 'T', 'r', 'k'});
     std::vector<uint8_t> trackData;
     uint32_t lastTime = 0;
 
-    for (auto& event : midi->Notes) {
-        auto data = event.GenerateEvent(lastTime);
-        trackData.insert(trackData.end(), data.begin(), data.end());
+    for (auto& event : *ordered) {
+        auto eventData = event.GenerateEvent(lastTime);
+        trackData.insert(trackData.end(), eventData.begin(), eventData.end());
         lastTime = event.Time;
     }
 
@@ -216,12 +1107,45 @@ std::shared_ptr<IObject> GenerateMidi(std::shared_ptr<IObject> self, const std::
     trackData.push_back(0x2F);  // End of track
     trackData.push_back(0x00);  // Meta event length
 
-    write_big_endian(file, trackData.size(), 4);
+    write_big_endian(data, trackData.size(), 4);
+    data.insert(data.end(), trackData.begin(), trackData.end());
+    return data;
+}
 
-    if (!trackData.empty()) {
-        file.write(reinterpret_cast<const char*>(trackData.data()), trackData.size());
+std::shared_ptr<IObject> GenerateMidi(std::shared_ptr<IObject> self, const std::vector<std::shared_ptr<IObject>>& args) {
+    if (self->Type() != ObjectType::MIDI) {
+        return std::make_shared<Error>(fmt::format("{} doesn't have the function GenerateMidi", self->Type()));
+    }
+
+    if (args.size() != 1) {
+        return std::make_shared<Error>(fmt::format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+
+    if (args[0]->Type() != ObjectType::STRING) {
+        return std::make_shared<Error>(fmt::format("type mismatch, want INTEGER got {0}", args[0]->Type()));
+    }
+
+    TraceSpan span("GenerateMidi");
+    auto midi = static_pointer_cast<MidiObj>(self);
+    // A sorted copy of the events and at most 8 bytes of each in the track
+    // and again in the file.
+    if (auto err = CheckHeap(midi->Notes.size(), sizeof(MidiNoteEvent) + 2 * 8)) return err;
+    std::string filename = ResolveOutputPath(static_pointer_cast<StringObj>(args[0])->Value);
+    auto data = EncodeMidi(*midi);
+
+    auto interpreter = Interpreter::Current();
+    if (interpreter != nullptr && !interpreter->WriteFiles) {
+        interpreter->Files[filename] = std::move(data);
+        return Env::NULLOBJ;
+    }
+
+    TraceSpan write("write");
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return std::make_shared<Error>(fmt::format("failed to create file with name={0}", filename));
     }
 
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
     file.close();
 
     return Env::NULLOBJ;
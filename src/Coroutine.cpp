@@ -0,0 +1,242 @@
+#include "Coroutine.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <ucontext.h>
+#endif
+
+// swapcontext saves the signal mask with a system call on every switch, which
+// costs more than the statements a generator runs between two values. On
+// x86-64 the stacks are switched by hand instead.
+#if defined(__x86_64__) && defined(__ELF__)
+#define COROUTINE_SWITCH_ASM
+
+// Saves the callee saved registers on the current stack and its stack pointer
+// in *save, then continues on the stack restore was saved from.
+extern "C" void SwitchCoroutineStack(void** save, void* restore);
+
+asm(R"(
+    .text
+    .p2align 4
+    .globl SwitchCoroutineStack
+    .hidden SwitchCoroutineStack
+    .type SwitchCoroutineStack, @function
+SwitchCoroutineStack:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size SwitchCoroutineStack, .-SwitchCoroutineStack
+)");
+#endif
+
+// AddressSanitizer keeps shadow state per stack, it has to be told about
+// every switch or it reports the frames of the other stack as overflows.
+#if defined(__SANITIZE_ADDRESS__)
+#define COROUTINE_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define COROUTINE_ASAN
+#endif
+#endif
+
+#ifdef COROUTINE_ASAN
+#include <sanitizer/asan_interface.h>
+#include <sanitizer/common_interface_defs.h>
+
+static void StartSwitch(void** fakeStack, const void* bottom, size_t size) {
+    __sanitizer_start_switch_fiber(fakeStack, bottom, size);
+}
+static void FinishSwitch(void* fakeStack, const void** bottom, size_t* size) {
+    __sanitizer_finish_switch_fiber(fakeStack, bottom, size);
+}
+// The frames a coroutine left on its stack stay poisoned after the stack is
+// unmapped, and a later stack mapped at the same address would inherit them.
+static void Unpoison(void* stack, size_t size) { ASAN_UNPOISON_MEMORY_REGION(stack, size); }
+#else
+static void StartSwitch(void**, const void*, size_t) {}
+static void FinishSwitch(void*, const void**, size_t*) {}
+static void Unpoison(void*, size_t) {}
+#endif
+
+static thread_local Coroutine* running = nullptr;
+
+#ifndef _WIN32
+// Inaccessible pages below every stack, so overflowing it faults rather than
+// writing over whatever is mapped below, which may be another stack. Larger
+// than a page, as a frame can skip one.
+const size_t GUARD_SIZE = 64 * 1024;
+#endif
+
+struct Coroutine::Context {
+    static void Start();
+#ifdef _WIN32
+    static void WINAPI StartFiber(LPVOID) { Start(); }
+
+    LPVOID Fiber = nullptr;
+    LPVOID Caller = nullptr;
+    // Fibers only reserve their stack once they start.
+    uintptr_t Low = 0;
+#else
+    void* Stack = MAP_FAILED;
+    // The stack of whoever resumed the coroutine last, and the fake stack
+    // of the coroutine while it is suspended, for the sanitizer.
+    const void* CallerBottom = nullptr;
+    size_t CallerSize = 0;
+    void* FakeStack = nullptr;
+#ifdef COROUTINE_SWITCH_ASM
+    void* Self = nullptr;
+    void* Caller = nullptr;
+#else
+    ucontext_t Self;
+    ucontext_t Caller;
+#endif
+#endif
+};
+
+Coroutine::Coroutine(std::function<void()> body, size_t stackSize)
+    : body(std::move(body)), stackSize(stackSize), context(std::make_unique<Context>()) {
+#ifdef _WIN32
+    context->Fiber = CreateFiberEx(0, stackSize, FIBER_FLAG_FLOAT_SWITCH, Context::StartFiber, nullptr);
+#else
+    context->Stack = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (context->Stack == MAP_FAILED) return;
+    if (stackSize <= GUARD_SIZE || mprotect(context->Stack, GUARD_SIZE, PROT_NONE) != 0) {
+        munmap(context->Stack, stackSize);
+        context->Stack = MAP_FAILED;
+        return;
+    }
+#ifdef COROUTINE_SWITCH_ASM
+    // The frame SwitchCoroutineStack restores, returning into Start as if it
+    // had been called.
+    auto top = (uint64_t*)(((uintptr_t)context->Stack + stackSize) & ~(uintptr_t)15);
+    top[-1] = 0;
+    top[-2] = (uint64_t)&Context::Start;
+    for (int i = 3; i <= 8; ++i) top[-i] = 0;
+    // The default floating point control words.
+    top[-9] = 0x1F80 | ((uint64_t)0x037F << 32);
+    context->Self = top - 9;
+#else
+    getcontext(&context->Self);
+    context->Self.uc_stack.ss_sp = (char*)context->Stack + GUARD_SIZE;
+    context->Self.uc_stack.ss_size = stackSize - GUARD_SIZE;
+    context->Self.uc_link = &context->Caller;
+    makecontext(&context->Self, Context::Start, 0);
+#endif
+#endif
+}
+
+Coroutine::~Coroutine() {
+#ifdef _WIN32
+    if (context->Fiber != nullptr) DeleteFiber(context->Fiber);
+#else
+    if (context->Stack == MAP_FAILED) return;
+    Unpoison((char*)context->Stack + GUARD_SIZE, stackSize - GUARD_SIZE);
+    munmap(context->Stack, stackSize);
+#endif
+}
+
+bool Coroutine::Valid() const {
+#ifdef _WIN32
+    return context->Fiber != nullptr;
+#else
+    return context->Stack != MAP_FAILED;
+#endif
+}
+
+uintptr_t Coroutine::StackLow() const {
+#ifdef _WIN32
+    return context->Low;
+#else
+    return Valid() ? (uintptr_t)context->Stack + GUARD_SIZE : 0;
+#endif
+}
+
+Coroutine* Coroutine::Running() { return running; }
+
+void Coroutine::Context::Start() {
+    auto self = running;
+#ifdef _WIN32
+    char top;
+    self->context->Low = (uintptr_t)&top - self->stackSize;
+#else
+    FinishSwitch(nullptr, &self->context->CallerBottom, &self->context->CallerSize);
+#endif
+    try {
+        self->body();
+    } catch (...) {
+        self->exception = std::current_exception();
+    }
+    self->done = true;
+#ifdef _WIN32
+    SwitchToFiber(self->context->Caller);
+#else
+    // Without a fake stack to keep, as the coroutine never runs again.
+    StartSwitch(nullptr, self->context->CallerBottom, self->context->CallerSize);
+#ifdef COROUTINE_SWITCH_ASM
+    SwitchCoroutineStack(&self->context->Self, self->context->Caller);
+#endif
+#endif
+}
+
+void Coroutine::Resume() {
+    if (!Valid() || done) return;
+    resumedBy = running;
+    running = this;
+#ifdef _WIN32
+    bool converted = !IsThreadAFiber();
+    context->Caller = converted ? ConvertThreadToFiber(nullptr) : GetCurrentFiber();
+    if (context->Caller != nullptr) SwitchToFiber(context->Fiber);
+    if (converted && context->Caller != nullptr) ConvertFiberToThread();
+#else
+    void* fakeStack = nullptr;
+    StartSwitch(&fakeStack, (char*)context->Stack + GUARD_SIZE, stackSize - GUARD_SIZE);
+#ifdef COROUTINE_SWITCH_ASM
+    SwitchCoroutineStack(&context->Caller, context->Self);
+#else
+    swapcontext(&context->Caller, &context->Self);
+#endif
+    FinishSwitch(fakeStack, nullptr, nullptr);
+#endif
+    running = resumedBy;
+    if (auto thrown = std::exchange(exception, nullptr)) std::rethrow_exception(thrown);
+}
+
+void Coroutine::Yield() {
+    auto self = running;
+    if (self == nullptr) return;
+#ifdef _WIN32
+    SwitchToFiber(self->context->Caller);
+#else
+    auto context = self->context.get();
+    StartSwitch(&context->FakeStack, context->CallerBottom, context->CallerSize);
+#ifdef COROUTINE_SWITCH_ASM
+    SwitchCoroutineStack(&context->Self, context->Caller);
+#else
+    swapcontext(&context->Self, &context->Caller);
+#endif
+    FinishSwitch(context->FakeStack, &context->CallerBottom, &context->CallerSize);
+#endif
+}
@@ -1,6 +1,7 @@
 #include "Enviroment.hpp"
 
 #include <memory>
+#include <utility>
 
 #include "Object.hpp"
 
@@ -8,10 +9,26 @@ HashKey Integer::GetHashKey() { return HashKey(*this); }
 HashKey BooleanObj::GetHashKey() { return HashKey(*this); }
 HashKey StringObj::GetHashKey() { return HashKey(*this); }
 
-std::shared_ptr<BooleanObj> Env::TRUE = std::make_shared<BooleanObj>(true);
-std::shared_ptr<BooleanObj> Env::FALSE = std::make_shared<BooleanObj>(false);
-std::shared_ptr<Null> Env::NULLOBJ = std::make_shared<Null>();
-std::shared_ptr<BreakObj> Env::BREAK = std::make_shared<BreakObj>();
+template <size_t... I>
+constexpr std::array<Integer, sizeof...(I)> MakeSmallIntegers(std::index_sequence<I...>) {
+    return {Integer(SMALL_INT_MIN + (int)I)...};
+}
+
+constinit std::array<Integer, SMALL_INT_MAX - SMALL_INT_MIN + 1> SmallIntegers =
+    MakeSmallIntegers(std::make_index_sequence<SMALL_INT_MAX - SMALL_INT_MIN + 1>());
+
+static constinit NoteObj Notes;
+static constinit TimeObj Times;
+
+static constinit BooleanObj True(true);
+static constinit BooleanObj False(false);
+static constinit Null NullObj;
+static constinit BreakObj Break;
+
+const std::shared_ptr<BooleanObj> Env::TRUE = Immortal(True);
+const std::shared_ptr<BooleanObj> Env::FALSE = Immortal(False);
+const std::shared_ptr<Null> Env::NULLOBJ = Immortal(NullObj);
+const std::shared_ptr<BreakObj> Env::BREAK = Immortal(Break);
 
 std::shared_ptr<IObject> Env::Set(std::string name, std::shared_ptr<IObject> val) {
     if (Outer != nullptr && Outer->Get(name) != nullptr) {
@@ -29,6 +46,7 @@ std::shared_ptr<IObject> Env::Set(std::string name, std::shared_ptr<IObject> ind
     if (auto hash = std::dynamic_pointer_cast<Hash>(obj)) {
         if (auto indexHash = std::dynamic_pointer_cast<IHashable>(index)) {
             hash->Pairs[indexHash->GetHashKey()] = HashPair(index, assignVal);
+            hash->Owned.Resize(hash->Pairs.size() * Hash::PAIR_BYTES);
             return assignVal;
         }
     } else if (auto array = std::dynamic_pointer_cast<ArrayObject>(obj)) {
@@ -43,15 +61,18 @@ std::shared_ptr<IObject> Env::Set(std::string name, std::shared_ptr<IObject> ind
     return Env::NULLOBJ;
 }
 
+// Lookups only use find, never operator[], as parallel map and filter read
+// the same shared environments from several threads.
 std::shared_ptr<IObject> Env::Get(std::string name) {
-    if (Store.find(name) == Store.end()) {
+    auto it = Store.find(name);
+    if (it == Store.end()) {
         if (Outer != nullptr) {
             return Outer->Get(name);
         } else
             return nullptr;
     }
 
-    return Store[name];
+    return it->second;
 }
 
 void Env::Remove(std::string name) {
@@ -62,31 +83,34 @@ void Env::Remove(std::string name) {
 
 std::shared_ptr<IObject> Env::GetHashObject(std::string name,
                                             std::shared_ptr<IHashable> index) {
-    if (Store.find(name) == Store.end()) {
+    auto it = Store.find(name);
+    if (it == Store.end()) {
         if (Outer != nullptr) {
             return Outer->GetHashObject(name, index);
         } else
             return nullptr;
     }
 
-    auto hash = std::dynamic_pointer_cast<Hash>(Store[name]);
+    auto hash = std::dynamic_pointer_cast<Hash>(it->second);
     if (!hash) return nullptr;
 
-    if (hash->Pairs.find(index->GetHashKey()) != hash->Pairs.end()) {
-        return hash->Pairs[index->GetHashKey()].Value;
+    auto pair = hash->Pairs.find(index->GetHashKey());
+    if (pair != hash->Pairs.end()) {
+        return pair->second.Value;
     }
     return nullptr;
 }
 
 std::shared_ptr<IObject> Env::GetArrayObject(std::string name, std::shared_ptr<Integer> index) {
-    if (Store.find(name) == Store.end()) {
+    auto it = Store.find(name);
+    if (it == Store.end()) {
         if (Outer != nullptr) {
             return Outer->GetArrayObject(name, index);
         } else
             return nullptr;
     }
 
-    auto array = std::dynamic_pointer_cast<ArrayObject>(Store[name]);
+    auto array = std::dynamic_pointer_cast<ArrayObject>(it->second);
     if (!array) return nullptr;
 
     if (0 < index->Value && index->Value < array->Elements.size()) {
@@ -120,3 +144,10 @@ std::shared_ptr<Env> NewEnclosedEnviroment(std::shared_ptr<Env> outer) {
     env->Outer = outer;
     return env;
 }
+
+std::shared_ptr<Env> NewGlobalEnviroment() {
+    std::shared_ptr<Env> env = std::make_shared<Env>();
+    env->Set("NOTES", Immortal(Notes));
+    env->Set("TIME", Immortal(Times));
+    return env;
+}
@@ -2,18 +2,29 @@
 
 #include <fmt/core.h>
 
+#include <climits>
 #include <cstdio>
 #include <map>
 #include <memory>
 
 #include "Ast.hpp"
 #include "Enviroment.hpp"
+#include "Flame.hpp"
+#include "Iterator.hpp"
+#include "Limits.hpp"
+#include "Trace.hpp"
 #include "Object.hpp"
 
 
 shared_ptr<IObject> ApplyFunction(shared_ptr<IObject> fn, vector<shared_ptr<IObject>> args, shared_ptr<Env> env, int line) {
     if (auto func = dynamic_pointer_cast<Function>(fn)) {
+        CallFrame call;
+        if (auto exceeded = call.Check(line)) return exceeded;
+        if (auto exceeded = CheckBudget(line)) return exceeded;
+        FlameFrame frame(func->Name->Value);
+        TraceSpan span(func->Name->Value, TraceSpan::FUNCTION);
         auto extEnv = ExtendFunctionEnv(func, args);
+        if (func->IsGenerator) return std::make_shared<GeneratorObj>(func, extEnv);
         auto evaluated = func->Body->Evaluate(extEnv);
         return UnwarpReturnValue(evaluated);
     } else if (auto builtin = dynamic_pointer_cast<BuiltinObj>(fn)) {
@@ -38,21 +49,11 @@ vector<shared_ptr<IObject>> EvalExpressions(vector<shared_ptr<Expression>> exps,
 shared_ptr<IObject> EvalAssignOperator(shared_ptr<IObject> oldVal, shared_ptr<IObject> newVal, string op, int line) {
     if (op == "=") {
         return newVal;
-    } else if (op == "+=") {
-        if (oldVal->Type() != ObjectType::INTEGER || newVal->Type() != ObjectType::INTEGER) {
+    } else if (op == "+=" || op == "-=" || op == "*=") {
+        if (!IsNumber(*oldVal) || !IsNumber(*newVal)) {
             return std::make_shared<Error>(fmt::format("at {0}, type mismatch: {1} {2} {3}", line, oldVal->Type(), op, newVal->Type()));
         }
-        return make_shared<Integer>(static_pointer_cast<Integer>(oldVal)->Value + static_pointer_cast<Integer>(newVal)->Value);
-    } else if (op == "-=") {
-        if (oldVal->Type() != ObjectType::INTEGER || newVal->Type() != ObjectType::INTEGER) {
-            return std::make_shared<Error>(fmt::format("at {0}, type mismatch: {1} {2} {3}", line, oldVal->Type(), op, newVal->Type()));
-        }
-        return make_shared<Integer>(static_pointer_cast<Integer>(oldVal)->Value - static_pointer_cast<Integer>(newVal)->Value);
-    } else if (op == "*=") {
-        if (oldVal->Type() != ObjectType::INTEGER || newVal->Type() != ObjectType::INTEGER) {
-            return std::make_shared<Error>(fmt::format("at {0}, type mismatch: {1} {2} {3}", line, oldVal->Type(), op, newVal->Type()));
-        }
-        return make_shared<Integer>(static_pointer_cast<Integer>(oldVal)->Value * static_pointer_cast<Integer>(newVal)->Value);
+        return EvalInfixExpression(op.substr(0, 1), oldVal, newVal, line);
     } else {
         return std::make_shared<Error>(fmt::format("at {0}, operator '{1}' not recognized", line, op));
     }
@@ -77,17 +78,21 @@ shared_ptr<IObject> EvalBangOperatorExpression(shared_ptr<IObject> obj) {
 }
 
 shared_ptr<IObject> EvalMinusOperatorExpression(shared_ptr<IObject> obj, int line) {
+    if (obj->Type() == ObjectType::FLOAT) return NewFloat(-static_pointer_cast<FloatObj>(obj)->Value);
     if (obj->Type() != ObjectType::INTEGER) {
         return std::make_shared<Error>(fmt::format("at {0}, unknown operaitor: -{1}", line, obj->Type()));
         ;
     }
-    return make_shared<Integer>(-(static_pointer_cast<Integer>(obj)->Value));
+    return NewInteger(-(static_pointer_cast<Integer>(obj)->Value));
 }
 
 shared_ptr<IObject> EvalInfixExpression(string op, shared_ptr<IObject> left, shared_ptr<IObject> right, int line) {
-    if (left->Type() == ObjectType::INTEGER && left->Type() == ObjectType::INTEGER) {
+    if (left->Type() == ObjectType::INTEGER && right->Type() == ObjectType::INTEGER) {
         return EvalIntegerInfixExpression(op, static_pointer_cast<Integer>(left), static_pointer_cast<Integer>(right), line);
     }
+    if (IsNumber(*left) && IsNumber(*right)) {
+        return EvalFloatInfixExpression(op, NumberValue(*left), NumberValue(*right), line);
+    }
 
     if (left->Type() != right->Type()) {
         return std::make_shared<Error>(fmt::format("at {0}, type mismatch: {1} {2} {3}", line, left->Type(), op, right->Type()));
@@ -110,13 +115,18 @@ shared_ptr<IObject> EvalIntegerInfixExpression(string op, shared_ptr<Integer> le
     int leftVal = left->Value;
     int rightVal = right->Value;
     if (op == "+") {
-        return make_shared<Integer>(leftVal + rightVal);
+        return NewInteger(leftVal + rightVal);
     } else if (op == "-") {
-        return make_shared<Integer>(leftVal - rightVal);
+        return NewInteger(leftVal - rightVal);
     } else if (op == "*") {
-        return make_shared<Integer>(leftVal * rightVal);
+        return NewInteger(leftVal * rightVal);
     } else if (op == "/") {
-        return make_shared<Integer>(leftVal / rightVal);
+        // Both trap in hardware and would take the whole process down.
+        if (rightVal == 0) return std::make_shared<Error>(fmt::format("at {0}, division by zero", line));
+        if (leftVal == INT_MIN && rightVal == -1) {
+            return std::make_shared<Error>(fmt::format("at {0}, integer overflow: {1} / -1", line, leftVal));
+        }
+        return NewInteger(leftVal / rightVal);
     } else if (op == "<") {
         return NativeBoolToBooleanObj(leftVal < rightVal);
     } else if (op == ">") {
@@ -129,6 +139,27 @@ shared_ptr<IObject> EvalIntegerInfixExpression(string op, shared_ptr<Integer> le
     return std::make_shared<Error>(fmt::format("at {0}, unknown operator: {1} {2} {3}", line, left->Type(), op, right->Type()));
 }
 
+shared_ptr<IObject> EvalFloatInfixExpression(string op, double left, double right, int line) {
+    if (op == "+") {
+        return NewFloat(left + right);
+    } else if (op == "-") {
+        return NewFloat(left - right);
+    } else if (op == "*") {
+        return NewFloat(left * right);
+    } else if (op == "/") {
+        return NewFloat(left / right);
+    } else if (op == "<") {
+        return NativeBoolToBooleanObj(left < right);
+    } else if (op == ">") {
+        return NativeBoolToBooleanObj(left > right);
+    } else if (op == "==") {
+        return NativeBoolToBooleanObj(left == right);
+    } else if (op == "!=") {
+        return NativeBoolToBooleanObj(left != right);
+    }
+    return std::make_shared<Error>(fmt::format("at {0}, unknown operator: FLOAT {1} FLOAT", line, op));
+}
+
 shared_ptr<IObject> EvalStringInfixExpression(string op, shared_ptr<StringObj> left, shared_ptr<StringObj> right, int line) {
     string leftVal = left->Value;
     string rightVal = right->Value;
@@ -167,8 +198,9 @@ shared_ptr<IObject> EvalHashIndexExpression(shared_ptr<Hash> hash, shared_ptr<IO
         return std::make_shared<Error>(fmt::format("at {0}, unusable as hash key: {1}", line, index->Type()));
     }
 
-    if (hash->Pairs.find(hashAble->GetHashKey()) != hash->Pairs.end()) {
-        return hash->Pairs[hashAble->GetHashKey()].Value;
+    auto pair = hash->Pairs.find(hashAble->GetHashKey());
+    if (pair != hash->Pairs.end()) {
+        return pair->second.Value;
     }
 
     return Env::NULLOBJ;
@@ -0,0 +1,80 @@
+#include "Flame.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+FlameSampler::FlameSampler(std::string root, std::chrono::microseconds interval) : root(root), interval(interval) {}
+
+FlameSampler::~FlameSampler() { Stop(); }
+
+void FlameSampler::Start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+    running = true;
+    sampler = std::thread([this] {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto next = std::chrono::steady_clock::now() + interval;
+        while (!stopped.wait_until(lock, next, [this] { return !running; })) {
+            Sample();
+            next += interval;
+        }
+    });
+}
+
+void FlameSampler::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    stopped.notify_all();
+    sampler.join();
+}
+
+// Push and Pop bump the version before touching the stack, like a seqlock.
+void FlameSampler::Push(const std::string* name) {
+    size_t d = depth.load(std::memory_order_relaxed);
+    version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (d < MAX_SHADOW_DEPTH) frames[d].store(name, std::memory_order_relaxed);
+    depth.store(d + 1, std::memory_order_release);
+}
+
+void FlameSampler::Pop() {
+    size_t d = depth.load(std::memory_order_relaxed);
+    version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    depth.store(d - 1, std::memory_order_release);
+}
+
+void FlameSampler::Sample() {
+    std::vector<const std::string*> stack;
+    // Retry a few times when a call or return raced with the copy, then
+    // give up on this sample rather than record a stack that never existed.
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        uint64_t before = version.load(std::memory_order_acquire);
+        size_t d = std::min(depth.load(std::memory_order_acquire), MAX_SHADOW_DEPTH);
+        stack.clear();
+        for (size_t i = 0; i < d; ++i) {
+            stack.push_back(frames[i].load(std::memory_order_relaxed));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) != before) continue;
+
+        std::string folded = root;
+        for (const std::string* name : stack) {
+            folded += ";" + *name;
+        }
+        Samples[folded]++;
+        return;
+    }
+}
+
+bool FlameSampler::Write(const std::string& fileName) const {
+    std::ofstream file(fileName);
+    for (const auto& [stack, count] : Samples) {
+        file << stack << " " << count << "\n";
+    }
+    return file.good();
+}
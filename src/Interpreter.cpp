@@ -0,0 +1,174 @@
+#include "Interpreter.hpp"
+
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <random>
+
+#include "Coroutine.hpp"
+#include "Lexer.hpp"
+#include "Module.hpp"
+#include "Parser.hpp"
+
+static thread_local Interpreter* current = nullptr;
+
+// Programs run on a stack of their own, reserved up front and committed as
+// recursion reaches it, so deep recursion does not depend on the stack of the
+// calling thread.
+const size_t EVALUATION_STACK_SIZE = (size_t)512 * 1024 * 1024;
+
+// Makes an interpreter current for the lifetime of the scope.
+class CurrentScope {
+   public:
+    CurrentScope(Interpreter* interpreter)
+        : previous(current),
+          previousProfiler(CurrentProfiler),
+          previousFlame(CurrentFlame),
+          previousStats(CurrentAllocStats),
+          previousTracer(CurrentTracer),
+          previousBudget(CurrentBudget),
+          previousCallStack(CurrentCallStack) {
+        current = interpreter;
+        CurrentProfiler = interpreter->Profile;
+        CurrentFlame = interpreter->Flame;
+        CurrentAllocStats = interpreter->Stats;
+        CurrentTracer = interpreter->Trace;
+        CurrentBudget = nullptr;
+        CurrentCallStack = nullptr;
+    }
+    ~CurrentScope() {
+        current = previous;
+        CurrentProfiler = previousProfiler;
+        CurrentFlame = previousFlame;
+        CurrentAllocStats = previousStats;
+        CurrentTracer = previousTracer;
+        CurrentBudget = previousBudget;
+        CurrentCallStack = previousCallStack;
+    }
+
+   private:
+    Interpreter* previous;
+    Profiler* previousProfiler;
+    FlameSampler* previousFlame;
+    AllocStats* previousStats;
+    Tracer* previousTracer;
+    Budget* previousBudget;
+    CallStack* previousCallStack;
+};
+
+Interpreter::Interpreter() : Globals(NewGlobalEnviroment()), Output(&std::cout) { SetSeed(std::random_device{}()); }
+
+void Interpreter::SetSeed(uint32_t seed) {
+    Seed = seed;
+    Rng.seed(seed);
+}
+
+Interpreter* Interpreter::Current() { return current; }
+
+std::shared_ptr<AstProgram> Interpreter::Compile(const std::string& source, const std::string& baseDir) {
+    CurrentScope scope(this);
+    // The parser lexes as it goes, so lexing is timed on its own pass.
+    if (CurrentTracer != nullptr) {
+        TraceSpan span("lex");
+        Lexer l(source);
+        while (l.NextToken().Type != TokenType::TOKEN_EOF) {
+        }
+    }
+
+    TraceSpan span("parse");
+    Lexer l(source);
+    Parser p(l, baseDir);
+    auto program = p.ParseProgram();
+    Errors = p.Errors;
+    if (!Errors.empty()) return nullptr;
+
+    ModuleCache::Instance().Prefetch(program, baseDir);
+    return program;
+}
+
+std::shared_ptr<AstProgram> Interpreter::Load(const std::string& fileName) {
+    std::string source;
+    {
+        CurrentScope scope(this);
+        TraceSpan span("read");
+        if (!ReadSourceFile(fileName, source)) {
+            Errors = {"could not open file '" + fileName + "'"};
+            return nullptr;
+        }
+    }
+    return Compile(source, std::filesystem::path(fileName).parent_path().string());
+}
+
+std::shared_ptr<IObject> Interpreter::Run(std::shared_ptr<AstProgram> program,
+                                          const std::map<std::string, std::shared_ptr<IObject>>& globals) {
+    Globals = NewGlobalEnviroment();
+    Globals->ExtendEnv(globals);
+    Modules.clear();
+    Midis.clear();
+    Files.clear();
+    return Evaluate(program);
+}
+
+std::shared_ptr<IObject> Interpreter::Evaluate(std::shared_ptr<AstProgram> program) {
+    std::shared_ptr<IObject> result;
+    auto body = [&]() {
+        // The heap limit needs live bytes even when no one asked for stats.
+        AllocStats heap;
+        CurrentScope scope(this);
+        TraceSpan span("evaluate");
+
+        CallStack calls{0, Limits.MaxDepth, 0};
+        if (auto running = Coroutine::Running(); running != nullptr && running->StackLow() != 0) {
+            calls.Limit = running->StackLow() + STACK_MARGIN;
+        }
+        CurrentCallStack = &calls;
+        if (!Limits.Any()) {
+            result = program->Evaluate(Globals);
+            return;
+        }
+
+        if (Limits.MaxHeapBytes != 0 && CurrentAllocStats == nullptr) CurrentAllocStats = &heap;
+        Budget budget(Limits, CurrentAllocStats);
+        CurrentBudget = &budget;
+        result = program->Evaluate(Globals);
+    };
+    Coroutine evaluation(body, EVALUATION_STACK_SIZE);
+    try {
+        if (evaluation.Valid()) {
+            evaluation.Resume();
+        } else {
+            // Without a stack of its own the run only has the depth limit.
+            body();
+        }
+    } catch (const std::bad_alloc&) {
+        // Ends this run only, the memory it held is freed as it unwinds.
+        result = std::make_shared<Error>("out of memory");
+    }
+    return result;
+}
+
+std::shared_ptr<IObject> Interpreter::Get(const std::string& name) {
+    return Globals->Get(name);
+}
+
+static void ReplaceAll(std::string& text, const std::string& field, const std::string& value) {
+    for (size_t at = text.find(field); at != std::string::npos; at = text.find(field, at + value.size())) {
+        text.replace(at, field.size(), value);
+    }
+}
+
+std::string ResolveOutputPath(const std::string& fileName) {
+    auto interpreter = Interpreter::Current();
+    if (interpreter == nullptr) return fileName;
+
+    std::filesystem::path path(fileName);
+    if (!interpreter->OutputTemplate.empty()) {
+        std::string name = interpreter->OutputTemplate;
+        ReplaceAll(name, "{name}", path.stem().string());
+        ReplaceAll(name, "{i}", std::to_string(interpreter->Variation));
+        ReplaceAll(name, "{seed}", std::to_string(interpreter->Seed));
+        path.replace_filename(name);
+    }
+    if (interpreter->OutputDir.empty() || path.is_absolute()) return path.string();
+    return (std::filesystem::path(interpreter->OutputDir) / path).string();
+}
@@ -0,0 +1,137 @@
+#include "Iterator.hpp"
+
+#include <utility>
+
+#include "Enviroment.hpp"
+#include "Evaluator.hpp"
+#include "fmt/core.h"
+
+// Reserved once a generator starts and freed when it ends, committed as its
+// recursion reaches it.
+const size_t GENERATOR_STACK_SIZE = (size_t)64 * 1024 * 1024;
+
+std::shared_ptr<IObject> ArrayIterator::Next() {
+    if (Position >= Array->Elements.size()) return nullptr;
+    return Array->Elements[Position++];
+}
+
+std::shared_ptr<IObject> RangeIterator::Next() {
+    if (Value >= High) return nullptr;
+    int current = Value;
+    Value += Steps;
+    return NewInteger(current);
+}
+
+std::shared_ptr<IObject> HashKeyIterator::Next() {
+    auto it = Last ? Of->Pairs.upper_bound(*Last) : Of->Pairs.begin();
+    if (it == Of->Pairs.end()) return nullptr;
+    Last = it->first;
+    return it->second.Key;
+}
+
+static void Put(std::map<HashKey, HashPair>& pairs, const std::string& key, std::shared_ptr<IObject> value) {
+    auto keyObj = std::make_shared<StringObj>(key);
+    pairs[HashKey(*keyObj)] = HashPair(keyObj, value);
+}
+
+std::shared_ptr<IObject> MidiEventIterator::Next() {
+    if (Position >= Midi->Notes.size()) return nullptr;
+    const auto& event = Midi->Notes[Position++];
+    std::map<HashKey, HashPair> pairs;
+    Put(pairs, "note", NewInteger(event.Note));
+    Put(pairs, "velocity", NewInteger(event.Velocity));
+    Put(pairs, "time", NewInteger((int)event.Time));
+    Put(pairs, "on", event.IsOnEvent ? Env::TRUE : Env::FALSE);
+    return std::make_shared<Hash>(pairs);
+}
+
+GeneratorObj::GeneratorObj(std::shared_ptr<Function> function, std::shared_ptr<Env> env)
+    : function(std::move(function)), env(std::move(env)) {}
+
+GeneratorObj::~GeneratorObj() {
+    if (body == nullptr || body->Done()) return;
+    // Lets the body return from its yield so what it holds is freed.
+    closing = true;
+    try {
+        Resume();
+    } catch (...) {
+    }
+}
+
+std::string GeneratorObj::Inspect() { return "generator " + function->Name->Value; }
+
+void GeneratorObj::Resume() {
+    auto previous = std::exchange(CurrentGenerator, this);
+    auto previousCalls = std::exchange(CurrentCallStack, &calls);
+    running = true;
+    try {
+        body->Resume();
+    } catch (...) {
+        running = false;
+        CurrentGenerator = previous;
+        CurrentCallStack = previousCalls;
+        throw;
+    }
+    running = false;
+    CurrentGenerator = previous;
+    CurrentCallStack = previousCalls;
+}
+
+std::shared_ptr<IObject> GeneratorObj::Next() {
+    if (running) {
+        return std::make_shared<Error>(fmt::format("generator {0} is already running", function->Name->Value));
+    }
+    if (body == nullptr) {
+        if (result != nullptr) return nullptr;
+        if (auto outer = CurrentCallStack) calls = CallStack{0, outer->MaxDepth, 0};
+        body = std::make_unique<Coroutine>(
+            [this]() {
+                if (auto low = Coroutine::Running()->StackLow()) calls.Limit = low + STACK_MARGIN;
+                result = UnwarpReturnValue(function->Body->Evaluate(env));
+            },
+            GENERATOR_STACK_SIZE);
+        if (!body->Valid()) {
+            body = nullptr;
+            return std::make_shared<Error>(fmt::format("could not make a stack for generator {0}", function->Name->Value));
+        }
+    }
+
+    Resume();
+    if (!body->Done()) return std::exchange(value, nullptr);
+
+    // Frees the stack as soon as the body ends.
+    body = nullptr;
+    env = nullptr;
+    if (IsError(result) || result->Type() == ObjectType::EXIT) return std::exchange(result, Env::NULLOBJ);
+    return nullptr;
+}
+
+std::shared_ptr<IObject> GeneratorObj::Yield(std::shared_ptr<IObject> value, int line) {
+    // A voice block in the body runs on a stack of its own.
+    if (Coroutine::Running() != body.get()) {
+        return std::make_shared<Error>(fmt::format("at {0}, cannot yield from inside a voice", line));
+    }
+    if (!closing) {
+        this->value = std::move(value);
+        Coroutine::Yield();
+    }
+    if (closing) return std::make_shared<Error>(fmt::format("at {0}, generator {1} was dropped", line, function->Name->Value));
+    return Env::NULLOBJ;
+}
+
+std::shared_ptr<IObject> Iterate(const std::shared_ptr<IObject>& obj) {
+    switch (obj->Type()) {
+        case ObjectType::ARRAY:
+            return std::make_shared<ArrayIterator>(static_pointer_cast<ArrayObject>(obj));
+        case ObjectType::ITER:
+            return std::make_shared<RangeIterator>(*static_pointer_cast<IterObj>(obj));
+        case ObjectType::HASH:
+            return std::make_shared<HashKeyIterator>(static_pointer_cast<Hash>(obj));
+        case ObjectType::MIDI:
+            return std::make_shared<MidiEventIterator>(static_pointer_cast<MidiObj>(obj));
+        case ObjectType::ITERATOR:
+            return obj;
+        default:
+            return nullptr;
+    }
+}
@@ -85,6 +85,12 @@ std::string TokenTypeToString(TokenType t) {
             return "FOR";
         case TokenType::IN:
             return "IN";
+        case TokenType::INCLUDE:
+            return "INCLUDE";
+        case TokenType::VOICE:
+            return "VOICE";
+        case TokenType::YIELD:
+            return "YIELD";
         case TokenType::ACCESS:
             return "ACCESS";
         default:
@@ -105,6 +111,7 @@ void Lexer::ReadChar() {
 Token Lexer::NextToken() {
     Token tok;
     SkipWhitespace();
+    tokenStart = position;
 
     switch (ch) {
         case '=':
@@ -290,9 +297,18 @@ TokenType Lexer::LookupIdent(std::string literal) {
 
 Token Lexer::ReadNumber() {
     int oldPos = position;
+    TokenType type = TokenType::INT;
     while (isdigit(ch)) {
         ReadChar();
     }
-    return Token(TokenType::INT, Input.substr(oldPos, position - oldPos), line,
+    // Digits after a point make it a float.
+    if (ch == '.' && isdigit(PeekChar())) {
+        type = TokenType::FLOAT;
+        ReadChar();
+        while (isdigit(ch)) {
+            ReadChar();
+        }
+    }
+    return Token(type, Input.substr(oldPos, position - oldPos), line,
                  position - positionOffset);
 }
@@ -0,0 +1,44 @@
+#include "Limits.hpp"
+
+#include <algorithm>
+
+#include "fmt/core.h"
+
+// Reading the clock on every step would cost more than the step itself.
+const uint64_t DEADLINE_CHECK_INTERVAL = 256;
+
+Budget::Budget(const RunLimits& limits, const AllocStats* heap)
+    : Limits(limits), heap(heap), deadline(std::chrono::steady_clock::now() + limits.Timeout) {}
+
+std::shared_ptr<IObject> Budget::Step(int line) {
+    steps++;
+    if (Limits.MaxSteps != 0 && steps > Limits.MaxSteps) {
+        return std::make_shared<Error>(fmt::format("at {0}, exceeded the limit of {1} steps", line, Limits.MaxSteps));
+    }
+    if (Limits.Timeout.count() != 0 && steps % DEADLINE_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() > deadline) {
+        return std::make_shared<Error>(fmt::format("at {0}, exceeded the time limit of {1} ms", line, Limits.Timeout.count()));
+    }
+    if (Limits.MaxHeapBytes != 0 && heap != nullptr && heap->LiveBytes > Limits.MaxHeapBytes) {
+        return std::make_shared<Error>(fmt::format("at {0}, exceeded the memory limit of {1} bytes", line, Limits.MaxHeapBytes));
+    }
+    return nullptr;
+}
+
+std::shared_ptr<IObject> Budget::Room(uint64_t count, size_t size) const {
+    if (Limits.MaxHeapBytes == 0 || heap == nullptr) return nullptr;
+    uint64_t left = heap->LiveBytes < Limits.MaxHeapBytes ? Limits.MaxHeapBytes - heap->LiveBytes : 0;
+    if (count <= left / std::max<size_t>(size, 1)) return nullptr;
+    return std::make_shared<Error>(fmt::format("exceeded the memory limit of {0} bytes", Limits.MaxHeapBytes));
+}
+
+std::shared_ptr<IObject> CallFrame::Check(int line) const {
+    if (stack == nullptr) return nullptr;
+    if (stack->MaxDepth != 0 && stack->Depth > stack->MaxDepth) {
+        return std::make_shared<Error>(fmt::format("at {0}, exceeded the limit of {1} nested calls", line, stack->MaxDepth));
+    }
+    char here;
+    if ((uintptr_t)&here < stack->Limit) {
+        return std::make_shared<Error>(fmt::format("at {0}, out of stack space after {1} nested calls", line, stack->Depth));
+    }
+    return nullptr;
+}
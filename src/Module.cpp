@@ -0,0 +1,138 @@
+#include "Module.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "Evaluator.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Profiler.hpp"
+#include "fmt/core.h"
+
+ModuleCache& ModuleCache::Instance() {
+    static ModuleCache cache;
+    return cache;
+}
+
+std::string ResolveModulePath(const std::string& path, const std::string& baseDir) {
+    std::filesystem::path resolved(path);
+    if (resolved.is_relative() && !baseDir.empty()) {
+        resolved = std::filesystem::path(baseDir) / resolved;
+    }
+
+    std::error_code ec;
+    auto canonical = std::filesystem::weakly_canonical(resolved, ec);
+    if (ec) return resolved.lexically_normal().string();
+    return canonical.string();
+}
+
+bool ReadSourceFile(const std::string& fileName, std::string& content) {
+    std::ifstream file(fileName);
+    if (!file.is_open()) return false;
+
+    content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return !(file.fail() && !file.eof());
+}
+
+static ParsedModule ParseModule(std::string path) {
+    ParsedModule parsed;
+    std::string source;
+    if (!ReadSourceFile(path, source)) {
+        parsed.Errors.push_back(fmt::format("could not read '{0}'", path));
+        return parsed;
+    }
+
+    auto dir = std::filesystem::path(path).parent_path().string();
+    Lexer l(source);
+    Parser p(l, dir);
+    parsed.Program = p.ParseProgram();
+    parsed.Errors = p.Errors;
+
+    // Nested includes start parsing before this module is ever evaluated.
+    if (parsed.Errors.empty()) {
+        ModuleCache::Instance().Prefetch(parsed.Program, dir);
+    }
+    return parsed;
+}
+
+std::shared_future<ParsedModule> ModuleCache::StartParse(const std::string& path) {
+    auto& entry = modules[path];
+    if (!entry.Parsed.valid()) {
+        std::error_code ec;
+        entry.ModifiedAt = std::filesystem::last_write_time(path, ec);
+        entry.Parsed = std::async(std::launch::async, ParseModule, path).share();
+    }
+    return entry.Parsed;
+}
+
+void ModuleCache::Prefetch(std::shared_ptr<AstProgram> program, const std::string& baseDir) {
+    for (const auto& stmt : program->Statements) {
+        auto include = std::dynamic_pointer_cast<IncludeStatement>(stmt);
+        if (!include) continue;
+
+        include->ResolvedPath = ResolveModulePath(include->Path, baseDir);
+        std::lock_guard<std::mutex> lock(mutex);
+        StartParse(include->ResolvedPath);
+    }
+}
+
+std::shared_ptr<IObject> ModuleCache::Load(const std::string& path, int line) {
+    std::shared_future<ParsedModule> parsedFuture;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        parsedFuture = StartParse(path);
+    }
+
+    // Outside of a run the module is evaluated every time.
+    std::map<std::string, std::shared_ptr<IObject>> unowned;
+    auto interpreter = Interpreter::Current();
+    auto& modules = interpreter != nullptr ? interpreter->Modules : unowned;
+    if (auto it = modules.find(path); it != modules.end()) {
+        if (it->second == nullptr) {
+            return std::make_shared<Error>(fmt::format("at {0}, circular include of '{1}'", line, path));
+        }
+        return it->second;
+    }
+    // Marks the module as being evaluated.
+    modules[path] = nullptr;
+
+    std::shared_ptr<IObject> result;
+    const ParsedModule& parsed = parsedFuture.get();
+    if (!parsed.Errors.empty()) {
+        result = std::make_shared<Error>(fmt::format("at {0}, could not include '{1}': {2}", line, path, parsed.Errors[0]));
+    } else {
+        auto env = NewGlobalEnviroment();
+        ProfileFileScope profile(path);
+        auto fin = parsed.Program->Evaluate(env);
+        if (IsError(fin)) {
+            result = std::make_shared<Error>(fmt::format("at {0}, in '{1}': {2}", line, path, static_pointer_cast<Error>(fin)->Message));
+        } else {
+            result = std::make_shared<ModuleObj>(path, env);
+        }
+    }
+
+    modules[path] = result;
+    return result;
+}
+
+bool ModuleCache::Refresh() {
+    // Declared before the lock so dropped parses are joined after it is
+    // released; they take it themselves to prefetch nested includes.
+    std::vector<Entry> dropped;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = modules.begin(); it != modules.end();) {
+        std::error_code ec;
+        auto modifiedAt = std::filesystem::last_write_time(it->first, ec);
+        if (modifiedAt != it->second.ModifiedAt) {
+            dropped.push_back(std::move(it->second));
+            it = modules.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return !dropped.empty();
+}
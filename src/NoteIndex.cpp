@@ -0,0 +1,49 @@
+#include "NoteIndex.hpp"
+
+#include <algorithm>
+
+#include "Object.hpp"
+
+void NoteIndex::Update(const std::vector<MidiNoteEvent>& notes) {
+    size_t count = notes.size() / 2;
+    if (indexed > count) indexed = 0;
+
+    // Notes added in time order since the last query extend the index.
+    bool ordered = true;
+    uint32_t last = indexed == 0 ? 0 : entries.back().Start;
+    for (size_t i = indexed; i < count && ordered; ++i) {
+        ordered = notes[2 * i].Time >= last;
+        last = notes[2 * i].Time;
+    }
+    if (!ordered || indexed == 0) {
+        entries.clear();
+        maxEnd.clear();
+        indexed = 0;
+    }
+
+    size_t first = entries.size();
+    for (size_t i = indexed; i < count; ++i) {
+        entries.push_back(Entry{notes[2 * i].Time, notes[2 * i + 1].Time, 2 * i});
+    }
+    if (!ordered || indexed == 0) {
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.Start < b.Start; });
+    }
+    for (size_t i = first; i < entries.size(); ++i) {
+        maxEnd.push_back(std::max(i == 0 ? 0 : maxEnd[i - 1], entries[i].End));
+    }
+    indexed = count;
+}
+
+std::vector<size_t> NoteIndex::Sounding(const std::vector<MidiNoteEvent>& notes, uint32_t from, uint32_t to) {
+    Update(notes);
+
+    auto begin = std::upper_bound(maxEnd.begin(), maxEnd.end(), from) - maxEnd.begin();
+    auto end = std::lower_bound(entries.begin(), entries.end(), to, [](const Entry& e, uint32_t t) { return e.Start < t; }) -
+               entries.begin();
+
+    std::vector<size_t> sounding;
+    for (auto i = begin; i < end; ++i) {
+        if (entries[i].End > from) sounding.push_back(entries[i].Event);
+    }
+    return sounding;
+}
@@ -0,0 +1,149 @@
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Coroutine.hpp"
+#include "Limits.hpp"
+
+// As large as the stack of a run, so calls nest as deep on every thread.
+// Reserved once per thread of the pool, committed as its recursion reaches it.
+const size_t WORKER_STACK_SIZE = (size_t)512 * 1024 * 1024;
+
+class ThreadPool {
+   public:
+    static ThreadPool& Instance() {
+        static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+    bool For(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& body) {
+        std::unique_lock job(busy, std::try_to_lock);
+        if (!job.owns_lock() || threads.empty()) return false;
+
+        size_t share = (count + shares.size() - 1) / shares.size();
+        for (size_t i = 0; i < shares.size(); ++i) {
+            shares[i].Next = std::min(i * share, count);
+            shares[i].End = std::min((i + 1) * share, count);
+        }
+        this->body = &body;
+        this->chunk = std::max<size_t>(chunk, 1);
+        maxDepth = CurrentCallStack != nullptr ? CurrentCallStack->MaxDepth : 0;
+        {
+            std::lock_guard lock(mutex);
+            working = threads.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        // The caller takes the last share, on its own stack and call stack.
+        auto previous = std::exchange(InParallelWorker, true);
+        Work(shares.size() - 1);
+        InParallelWorker = previous;
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [this] { return working == 0; });
+        }
+        if (auto thrown = std::exchange(exception, nullptr)) std::rethrow_exception(thrown);
+        return true;
+    }
+
+   private:
+    // Indices from Next up to End not taken yet, on a cache line of its own.
+    struct alignas(64) Share {
+        std::atomic<size_t> Next = 0;
+        size_t End = 0;
+    };
+
+    explicit ThreadPool(size_t workers) : shares(workers + 1) {
+        for (size_t i = 0; i < workers; ++i) threads.emplace_back([this, i] { Run(i); });
+    }
+
+    void Run(size_t self) {
+        InParallelWorker = true;
+        CallStack calls;
+        CurrentCallStack = &calls;
+        Coroutine stack(
+            [&] {
+                if (auto low = Coroutine::Running()->StackLow()) calls.Limit = low + STACK_MARGIN;
+                Wait(self, calls);
+            },
+            WORKER_STACK_SIZE);
+        if (stack.Valid()) {
+            stack.Resume();
+        } else {
+            // Without a stack of its own the calls only have the depth limit.
+            Wait(self, calls);
+        }
+    }
+
+    void Wait(size_t self, CallStack& calls) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            calls = CallStack{0, maxDepth, calls.Limit};
+            Work(self);
+            std::lock_guard lock(mutex);
+            if (--working == 0) finished.notify_one();
+        }
+    }
+
+    void Work(size_t self) {
+        for (size_t i = 0; i < shares.size(); ++i) {
+            auto& share = shares[(self + i) % shares.size()];
+            for (size_t begin; (begin = share.Next.fetch_add(chunk)) < share.End;) {
+                try {
+                    (*body)(begin, std::min(begin + chunk, share.End));
+                } catch (...) {
+                    std::lock_guard lock(mutex);
+                    if (exception == nullptr) exception = std::current_exception();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<Share> shares;
+    // Held by the caller of For for the whole call.
+    std::mutex busy;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    uint64_t generation = 0;
+    size_t working = 0;
+    bool stopping = false;
+
+    const std::function<void(size_t, size_t)>* body = nullptr;
+    size_t chunk = 1;
+    size_t maxDepth = 0;
+    std::exception_ptr exception;
+};
+
+size_t ParallelThreads() { return std::max(std::thread::hardware_concurrency(), 1u); }
+
+bool ParallelFor(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& body) {
+    if (ParallelThreads() == 1) return false;
+    return ThreadPool::Instance().For(count, chunk, body);
+}
@@ -1,18 +1,20 @@
 #include "Parser.hpp"
 
 #include <memory>
+#include <utility>
 
 #include "Ast.hpp"
 #include "Lexer.hpp"
 #include "Token.hpp"
 
-Parser::Parser(Lexer l) : lexer(l) {
+Parser::Parser(Lexer l, std::string baseDir) : lexer(l), baseDir(std::move(baseDir)) {
     curToken = lexer.NextToken();
     peekToken = lexer.NextToken();
     Errors = std::vector<std::string>();
 
     RegisterPrefix(TokenType::IDENT, std::bind(&Parser::ParseIdentifier, this));
     RegisterPrefix(TokenType::INT, std::bind(&Parser::ParseIntegerLiteral, this));
+    RegisterPrefix(TokenType::FLOAT, std::bind(&Parser::ParseFloatLiteral, this));
     RegisterPrefix(TokenType::BANG, std::bind(&Parser::ParsePrefixExpression, this));
     RegisterPrefix(TokenType::MINUS, std::bind(&Parser::ParsePrefixExpression, this));
     RegisterPrefix(TokenType::TRUE, std::bind(&Parser::ParseBoolean, this));
@@ -66,6 +68,12 @@ std::shared_ptr<Statement> Parser::ParseStatement() {
             return ParseBreakStatement();
         case TokenType::FUNCTION:
             return ParseFunctionStatement();
+        case TokenType::INCLUDE:
+            return ParseIncludeStatement();
+        case TokenType::VOICE:
+            return ParseVoiceStatement();
+        case TokenType::YIELD:
+            return ParseYieldStatement();
         case TokenType::COMMENT:
         case TokenType::SEMICOLON:
             return nullptr;
@@ -152,6 +160,44 @@ std::shared_ptr<BreakStatement> Parser::ParseBreakStatement() {
     return stmt;
 }
 
+std::shared_ptr<IncludeStatement> Parser::ParseIncludeStatement() {
+    auto stmt = std::make_shared<IncludeStatement>(curToken);
+    if (!ExpectPeek(TokenType::STRING)) return nullptr;
+
+    stmt->Path = curToken.Literal;
+    stmt->BaseDir = baseDir;
+    if (PeekTokenIs(TokenType::SEMICOLON)) NextToken();
+    return stmt;
+}
+
+std::shared_ptr<VoiceStatement> Parser::ParseVoiceStatement() {
+    auto stmt = std::make_shared<VoiceStatement>(curToken);
+    while (true) {
+        if (!ExpectPeek(TokenType::LBRACE)) return nullptr;
+        stmt->Voices.push_back(ParseBlockStatement());
+
+        // Voices written one after another start at the same time.
+        if (!PeekTokenIs(TokenType::VOICE)) break;
+        NextToken();
+    }
+    if (PeekTokenIs(TokenType::SEMICOLON)) NextToken();
+    return stmt;
+}
+
+std::shared_ptr<YieldStatement> Parser::ParseYieldStatement() {
+    auto stmt = std::make_shared<YieldStatement>(curToken);
+    if (functionDepth == 0) {
+        Errors.push_back("at line: " + std::to_string(curToken.LineNumber) + ", yield outside of a function");
+        return nullptr;
+    }
+    yielded = true;
+
+    NextToken();
+    stmt->Value = ParseExpression(Precedence::LOWEST);
+    if (PeekTokenIs(TokenType::SEMICOLON)) NextToken();
+    return stmt;
+}
+
 std::shared_ptr<Statement> Parser::ParseExpressionStatement() {
     auto stmt = std::make_shared<ExpressionStatement>(curToken);
     stmt->TheExpression = ParseExpression(Precedence::LOWEST);
@@ -214,6 +260,19 @@ std::shared_ptr<Expression> Parser::ParseIntegerLiteral() {
     return lit;
 }
 
+std::shared_ptr<Expression> Parser::ParseFloatLiteral() {
+    auto lit = std::make_shared<FloatLiteral>(curToken);
+    try {
+        lit->Value = NewFloat(std::stod(curToken.Literal));
+    } catch (...) {
+        Errors.push_back("at line: " + std::to_string(curToken.LineNumber) +
+                         ", could not parse " + curToken.Literal +
+                         " as float");
+        return nullptr;
+    }
+    return lit;
+}
+
 std::shared_ptr<Expression> Parser::ParseBoolean() {
     return std::make_shared<BooleanExpression>(curToken,
                                                CurTokenIs(TokenType::TRUE));
@@ -307,7 +366,13 @@ std::shared_ptr<FunctionLiteral> Parser::ParseFunctionStatement() {
     lit->Parameters = ParseFunctionParameters();
     if (!ExpectPeek(TokenType::LBRACE)) return nullptr;
 
+    // A function that yields anywhere in its own body is a generator.
+    functionDepth++;
+    bool outerYielded = std::exchange(yielded, false);
     lit->Body = ParseBlockStatement();
+    lit->IsGenerator = yielded;
+    yielded = outerYielded;
+    functionDepth--;
     return lit;
 }
 
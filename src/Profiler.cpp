@@ -0,0 +1,95 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "fmt/core.h"
+
+Profiler::Profiler(std::string mainFile) : Files{mainFile} {}
+
+void Profiler::Enter(std::string_view kind, int line) {
+    auto it = Kinds.find(kind);
+    if (it == Kinds.end()) it = Kinds.emplace(std::string(kind), Stats{}).first;
+
+    Frame frame{&it->second, &Lines[{file, line}], Clock::now(), 0};
+    frame.Kind->Calls++;
+    frame.Kind->Active++;
+    frame.Line->Calls++;
+    frame.Line->Active++;
+    frames.push_back(frame);
+}
+
+void Profiler::Exit() {
+    Frame frame = frames.back();
+    frames.pop_back();
+
+    std::chrono::duration<double> elapsed = Clock::now() - frame.Start;
+    double exclusive = elapsed.count() - frame.Children;
+    for (Stats* stats : {frame.Kind, frame.Line}) {
+        stats->Exclusive += exclusive;
+        // Only the outermost of nested calls adds its inclusive time.
+        if (--stats->Active == 0) stats->Inclusive += elapsed.count();
+    }
+    if (!frames.empty()) frames.back().Children += elapsed.count();
+}
+
+size_t Profiler::EnterFile(const std::string& name) {
+    size_t previous = file;
+    auto it = std::find(Files.begin(), Files.end(), name);
+    file = it - Files.begin();
+    if (it == Files.end()) Files.push_back(name);
+    return previous;
+}
+
+void Profiler::LeaveFile(size_t previous) { file = previous; }
+
+static std::vector<std::string> ReadLines(const std::string& fileName) {
+    std::vector<std::string> lines;
+    std::ifstream file(fileName);
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+void Profiler::Report(std::ostream& out, size_t top) const {
+    double total = 0;
+    for (const auto& [_, stats] : Kinds) {
+        total += stats.Exclusive;
+    }
+    auto percent = [&](double seconds) { return total > 0 ? seconds / total * 100 : 0; };
+
+    std::vector<std::pair<std::string, Stats>> kinds(Kinds.begin(), Kinds.end());
+    std::sort(kinds.begin(), kinds.end(), [](const auto& a, const auto& b) { return a.second.Exclusive > b.second.Exclusive; });
+
+    out << fmt::format("{0:<20} {1:>10} {2:>12} {3:>12} {4:>7}", "node", "calls", "incl ms", "excl ms", "excl %") << std::endl;
+    for (const auto& [kind, stats] : kinds) {
+        out << fmt::format("{0:<20} {1:>10} {2:>12.3f} {3:>12.3f} {4:>6.1f}%", kind, stats.Calls,
+                           stats.Inclusive * 1000, stats.Exclusive * 1000, percent(stats.Exclusive))
+            << std::endl;
+    }
+
+    std::vector<std::pair<std::pair<size_t, int>, Stats>> lines(Lines.begin(), Lines.end());
+    std::sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) { return a.second.Exclusive > b.second.Exclusive; });
+    if (lines.size() > top) lines.resize(top);
+
+    std::vector<std::vector<std::string>> sources;
+    for (const auto& name : Files) {
+        sources.push_back(ReadLines(name));
+    }
+
+    out << std::endl;
+    out << fmt::format("{0:<24} {1:>10} {2:>12} {3:>12} {4:>7}  {5}", "line", "calls", "incl ms", "excl ms", "excl %", "source") << std::endl;
+    for (const auto& [key, stats] : lines) {
+        const auto& [fileIndex, line] = key;
+        const auto& source = sources[fileIndex];
+        std::string text = line > 0 && line <= (int)source.size() ? source[line - 1] : "";
+        text.erase(0, text.find_first_not_of(" \t"));
+
+        std::string where = fmt::format("{0}:{1}", Files[fileIndex], line);
+        out << fmt::format("{0:<24} {1:>10} {2:>12.3f} {3:>12.3f} {4:>6.1f}%  {5}", where, stats.Calls,
+                           stats.Inclusive * 1000, stats.Exclusive * 1000, percent(stats.Exclusive), text)
+            << std::endl;
+    }
+}
@@ -0,0 +1,130 @@
+#include "Purity.hpp"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Ast.hpp"
+#include "Builtins.hpp"
+#include "Evaluator.hpp"
+
+// Builtins that neither touch the interpreter nor their arguments.
+static constexpr std::string_view PURE_BUILTINS[] = {"range", "int", "float", "scale", "chord", "euclid"};
+
+class PurityCheck {
+   public:
+    bool Function(const std::shared_ptr<::Function>& function) {
+        if (function->IsGenerator) return false;
+        if (!checking.insert(function.get()).second) return true;
+
+        Scope scope;
+        auto outer = std::exchange(this->scope, &scope);
+        auto& env = *function->Enviroment;
+        bool pure = std::all_of(function->Parameters.begin(), function->Parameters.end(),
+                                [&](const auto& parameter) { return Binds(parameter->Value, env); }) &&
+                    Node(function->Body.get(), env);
+        this->scope = outer;
+
+        // A parameter or variable of the function hides the builtin it is
+        // named after, wherever in the body it is bound.
+        return pure && std::none_of(scope.Builtins.begin(), scope.Builtins.end(),
+                                    [&](const std::string& name) { return scope.Locals.count(name) != 0; });
+    }
+
+   private:
+    // The names a function binds and the builtins it calls.
+    struct Scope {
+        std::set<std::string> Locals;
+        std::vector<std::string> Builtins;
+    };
+
+    // Setting a name that env can see sets it there rather than in the call.
+    bool Binds(const std::string& name, Env& env) {
+        scope->Locals.insert(name);
+        return env.Get(name) == nullptr;
+    }
+
+    bool Call(CallExpression& call, Env& env) {
+        auto name = dynamic_cast<Identifier*>(call.Function.get());
+        if (name == nullptr || !Nodes(call.Arguments, env)) return false;
+
+        if (auto value = env.Get(name->Value)) {
+            auto function = dynamic_pointer_cast<::Function>(value);
+            return function != nullptr && Function(function);
+        }
+        scope->Builtins.push_back(name->Value);
+        return LookupBuiltin(name->Value) != nullptr &&
+               std::find(std::begin(PURE_BUILTINS), std::end(PURE_BUILTINS), name->Value) != std::end(PURE_BUILTINS);
+    }
+
+    bool Access(AccessExpression& access, Env& env) {
+        if (!Node(access.Parent.get(), env)) return false;
+        auto stmt = dynamic_cast<ExpressionStatement*>(access.TheStatement.get());
+        if (stmt == nullptr) return false;
+        // NOTES->C5 and TIME->QUARTER.
+        if (dynamic_cast<Identifier*>(stmt->TheExpression.get()) != nullptr) return true;
+
+        auto call = dynamic_cast<CallExpression*>(stmt->TheExpression.get());
+        auto name = call != nullptr ? dynamic_cast<Identifier*>(call->Function.get()) : nullptr;
+        return name != nullptr && name->Value == "Type" && Nodes(call->Arguments, env);
+    }
+
+    template <typename T>
+    bool Nodes(const std::vector<std::shared_ptr<T>>& nodes, Env& env) {
+        return std::all_of(nodes.begin(), nodes.end(), [&](const auto& node) { return Node(node.get(), env); });
+    }
+
+    bool Node(::Node* node, Env& env) {
+        if (node == nullptr) return true;
+        if (dynamic_cast<Identifier*>(node) || dynamic_cast<IntegerLiteral*>(node) || dynamic_cast<FloatLiteral*>(node) ||
+            dynamic_cast<BooleanExpression*>(node) || dynamic_cast<StringLiteral*>(node) ||
+            dynamic_cast<BreakStatement*>(node)) {
+            return true;
+        }
+        if (auto prefix = dynamic_cast<PrefixExpression*>(node)) return Node(prefix->Right.get(), env);
+        if (auto infix = dynamic_cast<InfixExpression*>(node)) {
+            return Node(infix->Left.get(), env) && Node(infix->Right.get(), env);
+        }
+        if (auto index = dynamic_cast<IndexExpression*>(node)) {
+            return Node(index->Left.get(), env) && Node(index->Index.get(), env);
+        }
+        if (auto call = dynamic_cast<CallExpression*>(node)) return Call(*call, env);
+        if (auto access = dynamic_cast<AccessExpression*>(node)) return Access(*access, env);
+        if (auto let = dynamic_cast<LetStatement*>(node)) {
+            return Binds(let->Name->Value, env) && Node(let->Value.get(), env);
+        }
+        if (auto assign = dynamic_cast<AssignStatement*>(node)) {
+            // Index assignments change objects others may hold.
+            auto name = dynamic_cast<Identifier*>(assign->Name.get());
+            return name != nullptr && Binds(name->Value, env) && Node(assign->Value.get(), env);
+        }
+        if (auto stmt = dynamic_cast<ExpressionStatement*>(node)) return Node(stmt->TheExpression.get(), env);
+        if (auto ret = dynamic_cast<ReturnStatement*>(node)) return Node(ret->Value.get(), env);
+        if (auto block = dynamic_cast<BlockStatement*>(node)) return Nodes(block->Statements, env);
+        if (auto branch = dynamic_cast<IfExpression*>(node)) {
+            return Node(branch->Condition.get(), env) && Node(branch->Consequence.get(), env) &&
+                   Node(branch->Alternative.get(), env);
+        }
+        if (auto loop = dynamic_cast<ForExpression*>(node)) {
+            return Binds(loop->Iterative->Index->Value, env) && Node(loop->Iterative->Array.get(), env) &&
+                   Node(loop->Body.get(), env);
+        }
+        if (auto array = dynamic_cast<ArrayLiteral*>(node)) return Nodes(array->Elements, env);
+        if (auto hash = dynamic_cast<HashLiteral*>(node)) {
+            return std::all_of(hash->Pairs.begin(), hash->Pairs.end(), [&](const auto& pair) {
+                return Node(pair.first.get(), env) && Node(pair.second.get(), env);
+            });
+        }
+        // Includes, voices, yields and nested function definitions.
+        return false;
+    }
+
+    // Functions being checked, calls back into them change nothing.
+    std::set<const ::Function*> checking;
+    Scope* scope = nullptr;
+};
+
+bool IsPure(const std::shared_ptr<Function>& function) { return PurityCheck().Function(function); }
@@ -0,0 +1,39 @@
+#include "Random.hpp"
+
+void Xoshiro256::seed(uint64_t seed) {
+    for (auto& word : state) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        word = z ^ (z >> 31);
+    }
+}
+
+// Vose's method: columns below the mean are topped up from columns above it.
+AliasTable::AliasTable(const std::vector<double>& weights) : probability(weights.size()), alias(weights.size()) {
+    double total = 0;
+    for (double weight : weights) {
+        total += weight;
+    }
+
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        probability[i] = weights[i] * weights.size() / total;
+        (probability[i] < 1 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        size_t less = small.back();
+        size_t more = large.back();
+        small.pop_back();
+        alias[less] = more;
+        probability[more] -= 1 - probability[less];
+        if (probability[more] < 1) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // What is left is full up to rounding.
+    for (size_t i : large) probability[i] = 1;
+    for (size_t i : small) probability[i] = 1;
+}
@@ -0,0 +1,410 @@
+#include "Server.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+int Serve(const std::string& socketPath, size_t workers, const RunLimits& limits) {
+    std::cerr << "Error: --serve is not supported on this platform" << std::endl;
+    return 1;
+}
+
+int SubmitJob(const std::string& socketPath, const std::string& fileName, const std::string& outputDir) {
+    std::cerr << "Error: --client is not supported on this platform" << std::endl;
+    return 1;
+}
+
+#else
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include "Interpreter.hpp"
+#include "Module.hpp"
+#include "fmt/core.h"
+
+const int FILE_ERROR = 144;
+// Larger SOURCE jobs are refused before their body is read.
+const size_t MAX_SOURCE_BYTES = 16 * 1024 * 1024;
+
+class Connection {
+   public:
+    Connection(int fd) : fd(fd) {}
+    ~Connection() { close(fd); }
+
+    bool ReadLine(std::string& line) {
+        while (true) {
+            auto end = buffer.find('\n');
+            if (end != std::string::npos) {
+                line = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+                return true;
+            }
+            if (!Fill()) return false;
+        }
+    }
+
+    bool ReadBytes(size_t count, std::string& out) {
+        while (buffer.size() < count) {
+            if (!Fill()) return false;
+        }
+        out = buffer.substr(0, count);
+        buffer.erase(0, count);
+        return true;
+    }
+
+    bool Write(const std::string& line) {
+        std::string data = line + "\n";
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+   private:
+    bool Fill() {
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+
+    int fd;
+    std::string buffer;
+};
+
+// Sends everything written to it as "OUT <line>" messages.
+class LineStreamBuf : public std::streambuf {
+   public:
+    LineStreamBuf(Connection& conn) : conn(conn) {}
+    void Finish() {
+        if (!line.empty()) conn.Write("OUT " + line);
+        line.clear();
+    }
+
+   protected:
+    int overflow(int ch) override {
+        if (ch == traits_type::eof()) return 0;
+        if (ch == '\n') {
+            conn.Write("OUT " + line);
+            line.clear();
+        } else {
+            line.push_back((char)ch);
+        }
+        return ch;
+    }
+
+   private:
+    Connection& conn;
+    std::string line;
+};
+
+// Messages are one line each, so the line breaks of an error are escaped.
+static std::string EscapeLine(const std::string& text) {
+    std::string escaped;
+    for (char ch : text) {
+        if (ch == '\\') {
+            escaped += "\\\\";
+        } else if (ch == '\n') {
+            escaped += "\\n";
+        } else if (ch == '\r') {
+            escaped += "\\r";
+        } else {
+            escaped.push_back(ch);
+        }
+    }
+    return escaped;
+}
+
+static std::string UnescapeLine(const std::string& text) {
+    std::string line;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\' || i + 1 == text.size()) {
+            line.push_back(text[i]);
+            continue;
+        }
+        char next = text[++i];
+        line.push_back(next == 'n' ? '\n' : next == 'r' ? '\r' : next);
+    }
+    return line;
+}
+
+static void WriteError(Connection& conn, const std::string& message) { conn.Write("ERR " + EscapeLine(message)); }
+
+struct Job {
+    std::string Path;
+    std::string Source;
+    std::string OutputDir;
+    std::string BaseDir;
+};
+
+// A job read from a connection, answered on it by the worker that takes it.
+struct QueuedJob {
+    std::shared_ptr<Connection> Conn;
+    Job Work;
+    std::promise<void> Done;
+};
+
+// Jobs waiting for a worker. Shared by Serve, its workers and the readers of
+// every connection, so it lives as long as the last of them.
+class JobQueue {
+   public:
+    // Returns false once the queue is stopped.
+    bool Push(QueuedJob job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopped) return false;
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    // Waits for a job, returns false once the queue is stopped and empty.
+    bool Pop(QueuedJob& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&] { return stopped || !jobs.empty(); });
+        if (jobs.empty()) return false;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        return true;
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        ready.notify_all();
+    }
+
+   private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<QueuedJob> jobs;
+    bool stopped = false;
+};
+
+// Returns false when the client closed the connection, or when the length of
+// a SOURCE job is invalid: where its body ends is unknown then, so the error is
+// answered here and the connection is given up.
+static bool ReadJob(Connection& conn, Job& job, std::string& error) {
+    std::string line;
+    size_t sourceLength = 0;
+    bool hasSource = false;
+
+    while (true) {
+        if (!conn.ReadLine(line)) return false;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) break;
+
+        auto space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+
+        if (key == "RUN") {
+            job.Path = value;
+        } else if (key == "SOURCE") {
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), sourceLength);
+            if (ec != std::errc() || end != value.data() + value.size() || sourceLength > MAX_SOURCE_BYTES) {
+                WriteError(conn, fmt::format("invalid source length '{0}', at most {1} bytes are accepted", value, MAX_SOURCE_BYTES));
+                conn.Write("DONE 1");
+                return false;
+            }
+            hasSource = true;
+        } else if (key == "OUTDIR") {
+            job.OutputDir = value;
+        } else if (key == "BASEDIR") {
+            job.BaseDir = value;
+        } else {
+            error = fmt::format("unknown header '{0}'", key);
+        }
+    }
+
+    if (hasSource && !conn.ReadBytes(sourceLength, job.Source)) return false;
+    if (error.empty() && job.Path.empty() && !hasSource) error = "job has neither RUN nor SOURCE";
+    return true;
+}
+
+static void RunJob(Connection& conn, const Job& job, const RunLimits& limits) {
+    std::string source = job.Source;
+    std::string baseDir = job.BaseDir;
+    if (!job.Path.empty()) {
+        if (!ReadSourceFile(job.Path, source)) {
+            WriteError(conn, fmt::format("could not open file '{0}'", job.Path));
+            conn.Write(fmt::format("DONE {0}", FILE_ERROR));
+            return;
+        }
+        baseDir = std::filesystem::path(job.Path).parent_path().string();
+    }
+
+    LineStreamBuf buf(conn);
+    std::ostream out(&buf);
+    Interpreter interpreter;
+    interpreter.Output = &out;
+    interpreter.OutputDir = job.OutputDir;
+    interpreter.Limits = limits;
+
+    // Libraries edited since the last job are parsed again.
+    ModuleCache::Instance().Refresh();
+    auto program = interpreter.Compile(source, baseDir);
+    if (program == nullptr) {
+        for (const auto& err : interpreter.Errors) {
+            WriteError(conn, err);
+        }
+        conn.Write("DONE 1");
+        return;
+    }
+
+    auto fin = interpreter.Run(program);
+    out.flush();
+    buf.Finish();
+
+    int code = 0;
+    if (fin->Type() == ObjectType::EXIT) {
+        code = static_pointer_cast<ExitObject>(fin)->Value;
+    } else if (fin->Type() == ObjectType::ERROR) {
+        WriteError(conn, static_pointer_cast<Error>(fin)->Message);
+        code = 1;
+    }
+    conn.Write(fmt::format("DONE {0}", code));
+}
+
+// Queues the jobs of a connection one at a time, so a worker is only taken
+// while a job runs and the answers go out in the order the jobs came in.
+static void ReadJobs(std::shared_ptr<Connection> conn, std::shared_ptr<JobQueue> queue) {
+    while (true) {
+        Job job;
+        std::string error;
+        if (!ReadJob(*conn, job, error)) return;
+
+        if (!error.empty()) {
+            WriteError(*conn, error);
+            conn->Write("DONE 1");
+            continue;
+        }
+
+        std::promise<void> done;
+        auto finished = done.get_future();
+        if (!queue->Push(QueuedJob{conn, std::move(job), std::move(done)})) {
+            WriteError(*conn, "the server is shutting down");
+            conn->Write("DONE 1");
+            return;
+        }
+        finished.wait();
+    }
+}
+
+static bool MakeAddress(const std::string& socketPath, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path '" << socketPath << "' is too long" << std::endl;
+        return false;
+    }
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    return true;
+}
+
+int Serve(const std::string& socketPath, size_t workers, const RunLimits& limits) {
+    // A client hanging up mid job must not take the server down.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un addr;
+    if (!MakeAddress(socketPath, addr)) return 1;
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (server < 0 || bind(server, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(server, 64) < 0) {
+        std::cerr << "Error: could not listen on '" << socketPath << "' - " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << fmt::format("listening on {0} with {1} workers", socketPath, workers) << std::endl;
+
+    auto queue = std::make_shared<JobQueue>();
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < workers; ++i) {
+        pool.emplace_back([queue, &limits] {
+            QueuedJob job;
+            while (queue->Pop(job)) {
+                RunJob(*job.Conn, job.Work, limits);
+                job.Done.set_value();
+                job = QueuedJob();
+            }
+        });
+    }
+
+    while (true) {
+        int fd = accept(server, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: accept failed - " << std::strerror(errno) << std::endl;
+            break;
+        }
+        // Readers wait on their client, not on a worker, and are left behind
+        // when the server stops; they only hold the queue and their connection.
+        std::thread(ReadJobs, std::make_shared<Connection>(fd), queue).detach();
+    }
+
+    close(server);
+    // Jobs already queued still run.
+    queue->Stop();
+    for (auto& worker : pool) worker.join();
+    return 1;
+}
+
+int SubmitJob(const std::string& socketPath, const std::string& fileName, const std::string& outputDir) {
+    sockaddr_un addr;
+    if (!MakeAddress(socketPath, addr)) return 1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "Error: could not connect to '" << socketPath << "' - " << std::strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    Connection conn(fd);
+    std::error_code ec;
+    auto path = std::filesystem::absolute(fileName, ec).string();
+    auto dir = std::filesystem::absolute(outputDir.empty() ? "." : outputDir, ec).string();
+    conn.Write("RUN " + path);
+    conn.Write("OUTDIR " + dir);
+    conn.Write("");
+
+    std::string line;
+    while (conn.ReadLine(line)) {
+        if (line.rfind("OUT ", 0) == 0) {
+            std::cout << line.substr(4) << std::endl;
+        } else if (line.rfind("ERR ", 0) == 0) {
+            std::cerr << UnescapeLine(line.substr(4)) << std::endl;
+        } else if (line.rfind("DONE ", 0) == 0) {
+            return std::atoi(line.c_str() + 5);
+        }
+    }
+
+    std::cerr << "Error: the server closed the connection" << std::endl;
+    return 1;
+}
+
+#endif
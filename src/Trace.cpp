@@ -0,0 +1,50 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "fmt/core.h"
+
+Tracer::Tracer() : start(Clock::now()) {}
+
+void Tracer::Add(std::string name, const char* category, Clock::time_point begin, Clock::time_point end) {
+    std::chrono::duration<double, std::micro> offset = begin - start;
+    std::chrono::duration<double, std::micro> duration = end - begin;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto id = std::this_thread::get_id();
+    auto it = std::find(threads.begin(), threads.end(), id);
+    size_t thread = it - threads.begin();
+    if (it == threads.end()) threads.push_back(id);
+
+    events.push_back(Event{std::move(name), category, offset.count(), duration.count(), thread});
+}
+
+static std::string Escape(const std::string& text) {
+    std::string escaped;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            escaped += '\\';
+            escaped += ch;
+        } else if ((unsigned char)ch < 0x20) {
+            escaped += fmt::format("\\u{0:04x}", ch);
+        } else {
+            escaped += ch;
+        }
+    }
+    return escaped;
+}
+
+bool Tracer::Write(const std::string& fileName) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream file(fileName);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const auto& event = events[i];
+        file << (i == 0 ? "\n" : ",\n");
+        file << fmt::format("{{\"name\": \"{0}\", \"cat\": \"{1}\", \"ph\": \"X\", \"ts\": {2:.3f}, \"dur\": {3:.3f}, \"pid\": 1, \"tid\": {4}}}",
+                            Escape(event.Name), event.Category, event.Start, event.Duration, event.Thread);
+    }
+    file << "\n]}\n";
+    return file.good();
+}
@@ -0,0 +1,70 @@
+#include "Variations.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Interpreter.hpp"
+#include "fmt/core.h"
+
+int RenderVariations(const std::string& fileName, const VariationOptions& options) {
+    Interpreter compiler;
+    auto program = compiler.Load(fileName);
+    if (program == nullptr) {
+        for (const auto& err : compiler.Errors) {
+            std::cerr << err << std::endl;
+        }
+        return 1;
+    }
+
+    size_t workers = options.Workers;
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    workers = std::min(workers, options.Count);
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> failed = false;
+    std::mutex printing;
+    std::vector<std::thread> pool;
+
+    for (size_t w = 0; w < workers; ++w) {
+        pool.emplace_back([&] {
+            for (size_t i = next++; i < options.Count; i = next++) {
+                std::ostringstream out;
+                Interpreter interpreter;
+                interpreter.Output = &out;
+                interpreter.OutputTemplate = options.OutputTemplate;
+                interpreter.Variation = i;
+                interpreter.SetSeed(options.Seed + (uint32_t)i);
+                interpreter.Limits = options.Limits;
+                auto fin = interpreter.Run(program);
+
+                std::lock_guard<std::mutex> lock(printing);
+                auto printed = out.str();
+                if (!printed.empty()) {
+                    std::cout << fmt::format("== variation {0} (seed {1}) ==", i, interpreter.Seed) << std::endl;
+                    std::cout << printed;
+                    if (printed.back() != '\n') std::cout << std::endl;
+                }
+                if (fin->Type() == ObjectType::ERROR) {
+                    std::cerr << fmt::format("variation {0}: {1}", i, fin->Inspect()) << std::endl;
+                    failed = true;
+                } else if (fin->Type() == ObjectType::EXIT && static_pointer_cast<ExitObject>(fin)->Value != 0) {
+                    failed = true;
+                }
+            }
+        });
+    }
+    for (auto& worker : pool) worker.join();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << fmt::format("rendered {0} variations on {1} threads in {2:.1f} ms", options.Count, workers, elapsed.count())
+              << std::endl;
+    return failed ? 1 : 0;
+}
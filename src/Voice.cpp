@@ -0,0 +1,174 @@
+#include "Voice.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+#include "Ast.hpp"
+#include "Coroutine.hpp"
+#include "Enviroment.hpp"
+#include "Evaluator.hpp"
+#include "Limits.hpp"
+#include "fmt/core.h"
+
+// Voices recurse on stacks of their own, committed as they are reached.
+const size_t VOICE_STACK_SIZE = (size_t)64 * 1024 * 1024;
+
+struct VoiceGroup;
+
+struct Voice {
+    VoiceGroup* Group;
+    // Voices at the same time run in the order they were written.
+    size_t Order;
+    int64_t Cursor = 0;
+    CallStack Calls;
+    std::unique_ptr<Coroutine> Body;
+    std::shared_ptr<IObject> Result;
+};
+
+struct VoiceGroup {
+    struct Track {
+        // Kept alive so the time can be moved once the voices end.
+        std::shared_ptr<MidiObj> Midi;
+        int Base;
+    };
+
+    struct Waiting {
+        int64_t Cursor;
+        size_t Order;
+        Voice* Paused;
+
+        bool operator>(const Waiting& other) const {
+            return Cursor != other.Cursor ? Cursor > other.Cursor : Order > other.Order;
+        }
+    };
+
+    // The voice running the group, nullptr at the top level.
+    Voice* Parent;
+    std::unordered_map<MidiObj*, Track> Tracks;
+    std::priority_queue<Waiting, std::vector<Waiting>, std::greater<Waiting>> Ready;
+    bool Stopped = false;
+};
+
+static int TimeIn(Voice* voice, const std::shared_ptr<MidiObj>& midi);
+
+static VoiceGroup::Track& TrackOf(VoiceGroup& group, const std::shared_ptr<MidiObj>& midi) {
+    auto it = group.Tracks.find(midi.get());
+    if (it == group.Tracks.end()) {
+        it = group.Tracks.emplace(midi.get(), VoiceGroup::Track{midi, TimeIn(group.Parent, midi)}).first;
+    }
+    return it->second;
+}
+
+static int TimeIn(Voice* voice, const std::shared_ptr<MidiObj>& midi) {
+    if (voice == nullptr) return midi->currentTime;
+    return (int)(TrackOf(*voice->Group, midi).Base + voice->Cursor);
+}
+
+int VoiceTime(const std::shared_ptr<MidiObj>& midi) { return TimeIn(CurrentVoice, midi); }
+
+void SetVoiceTime(const std::shared_ptr<MidiObj>& midi, int time) {
+    auto voice = CurrentVoice;
+    voice->Cursor = time - TrackOf(*voice->Group, midi).Base;
+}
+
+std::shared_ptr<IObject> SwitchVoice() {
+    auto voice = CurrentVoice;
+    auto& group = *voice->Group;
+    bool behind = !group.Ready.empty() && !(group.Ready.top() > VoiceGroup::Waiting{voice->Cursor, voice->Order, voice});
+    // A generator the voice takes values from runs on a stack of its own,
+    // which keeps running until it yields.
+    bool switchable = Coroutine::Running() == voice->Body.get();
+    if (!group.Stopped && behind && switchable) Coroutine::Yield();
+    if (group.Stopped) return std::make_shared<Error>("stopped because another voice failed");
+    return nullptr;
+}
+
+// Runs voice as the current voice until it moves past another or ends.
+static void ResumeVoice(Voice* voice, Voice* parent, CallStack* parentCalls) {
+    CurrentVoice = voice;
+    CurrentCallStack = &voice->Calls;
+    try {
+        voice->Body->Resume();
+    } catch (...) {
+        CurrentVoice = parent;
+        CurrentCallStack = parentCalls;
+        throw;
+    }
+    CurrentVoice = parent;
+    CurrentCallStack = parentCalls;
+}
+
+std::shared_ptr<IObject> RunVoices(const std::vector<std::shared_ptr<BlockStatement>>& blocks, std::shared_ptr<Env> env,
+                                   int line) {
+    auto parent = CurrentVoice;
+    auto parentCalls = CurrentCallStack;
+    VoiceGroup group{parent, {}, {}, false};
+
+    std::vector<std::unique_ptr<Voice>> voices;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        auto voice = std::make_unique<Voice>();
+        voice->Group = &group;
+        voice->Order = i;
+        if (parentCalls != nullptr) voice->Calls = CallStack{parentCalls->Depth, parentCalls->MaxDepth, 0};
+        voice->Body = std::make_unique<Coroutine>(
+            [voice = voice.get(), block = blocks[i], venv = NewEnclosedEnviroment(env)]() {
+                if (auto low = Coroutine::Running()->StackLow()) voice->Calls.Limit = low + STACK_MARGIN;
+                voice->Result = block->Evaluate(venv);
+            },
+            VOICE_STACK_SIZE);
+        if (!voice->Body->Valid()) {
+            return std::make_shared<Error>(fmt::format("at {0}, could not make a stack for a voice", line));
+        }
+        group.Ready.push({0, i, voice.get()});
+        voices.push_back(std::move(voice));
+    }
+
+    std::shared_ptr<IObject> failure;
+    int64_t length = 0;
+    while (!group.Ready.empty()) {
+        auto voice = group.Ready.top().Paused;
+        group.Ready.pop();
+
+        try {
+            ResumeVoice(voice, parent, parentCalls);
+        } catch (...) {
+            // The others return from where they wait, so nothing is left on
+            // their stacks when they are destroyed.
+            group.Stopped = true;
+            while (!group.Ready.empty()) {
+                auto waiting = group.Ready.top().Paused;
+                group.Ready.pop();
+                while (!waiting->Body->Done()) {
+                    try {
+                        ResumeVoice(waiting, parent, parentCalls);
+                    } catch (...) {
+                    }
+                }
+            }
+            throw;
+        }
+
+        if (!voice->Body->Done()) {
+            group.Ready.push({voice->Cursor, voice->Order, voice});
+            continue;
+        }
+        length = std::max(length, voice->Cursor);
+        auto result = voice->Result;
+        if (failure == nullptr && (IsError(result) || result->Type() == ObjectType::EXIT)) {
+            failure = result;
+            group.Stopped = true;
+        }
+    }
+    if (failure != nullptr) return failure;
+
+    // The voices end together, at the end of the longest.
+    if (parent != nullptr) {
+        parent->Cursor += length;
+    } else {
+        for (auto& [_, track] : group.Tracks) {
+            track.Midi->currentTime = (int)(track.Base + length);
+        }
+    }
+    return Env::NULLOBJ;
+}
@@ -0,0 +1,303 @@
+#include "Watch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Module.hpp"
+#include "Parser.hpp"
+#include "fmt/core.h"
+
+const auto WATCH_INTERVAL = std::chrono::milliseconds(100);
+
+static bool EndsValue(TokenType t) {
+    switch (t) {
+        case TokenType::IDENT:
+        case TokenType::INT:
+        case TokenType::FLOAT:
+        case TokenType::STRING:
+        case TokenType::TRUE:
+        case TokenType::FALSE:
+        case TokenType::RPAREN:
+        case TokenType::RBRACKET:
+        case TokenType::RBRACE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool StartsStatement(TokenType t, TokenType prev) {
+    switch (t) {
+        case TokenType::LET:
+        case TokenType::FUNCTION:
+        case TokenType::FOR:
+        case TokenType::RETURN:
+        case TokenType::BREAK:
+        case TokenType::INCLUDE:
+        case TokenType::VOICE:
+        case TokenType::YIELD:
+        case TokenType::COMMENT:
+            return true;
+        case TokenType::IDENT:
+        case TokenType::IF:
+            return EndsValue(prev);
+        default:
+            return prev == TokenType::SEMICOLON || prev == TokenType::COMMENT;
+    }
+}
+
+std::vector<SourceSpan> SplitTopLevel(const std::string& source) {
+    std::vector<SourceSpan> spans;
+    Lexer l(source);
+    int depth = 0;
+    bool first = true;
+    TokenType prev = TokenType::ILLEGAL;
+
+    while (true) {
+        Token tok = l.NextToken();
+        if (tok.Type == TokenType::TOKEN_EOF) break;
+
+        if (first) {
+            spans.push_back(SourceSpan{l.TokenStart(), source.size(), tok.LineNumber});
+            first = false;
+        } else if (depth == 0 && StartsStatement(tok.Type, prev)) {
+            spans.back().End = l.TokenStart();
+            spans.push_back(SourceSpan{l.TokenStart(), source.size(), tok.LineNumber});
+        }
+
+        if (tok.Type == TokenType::LPAREN || tok.Type == TokenType::LBRACE || tok.Type == TokenType::LBRACKET) {
+            depth++;
+        } else if (tok.Type == TokenType::RPAREN || tok.Type == TokenType::RBRACE || tok.Type == TokenType::RBRACKET) {
+            depth--;
+        }
+        prev = tok.Type;
+    }
+    return spans;
+}
+
+static void ShiftLines(Node* node, int64_t delta);
+
+template <typename T>
+static void ShiftLines(const std::shared_ptr<T>& node, int64_t delta) {
+    ShiftLines(node.get(), delta);
+}
+
+template <typename T>
+static void ShiftLines(const std::vector<std::shared_ptr<T>>& nodes, int64_t delta) {
+    for (const auto& node : nodes) ShiftLines(node.get(), delta);
+}
+
+static void Shift(Token& token, int64_t delta) { token.LineNumber = (size_t)((int64_t)token.LineNumber + delta); }
+
+// Moves every token under node delta lines, for statements reused after the
+// lines above them changed.
+static void ShiftLines(Node* node, int64_t delta) {
+    if (node == nullptr) return;
+    if (auto n = dynamic_cast<Identifier*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<IntegerLiteral*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<FloatLiteral*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<BooleanExpression*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<StringLiteral*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<BreakStatement*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<IncludeStatement*>(node)) {
+        Shift(n->TheToken, delta);
+    } else if (auto n = dynamic_cast<PrefixExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Right, delta);
+    } else if (auto n = dynamic_cast<InfixExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Left, delta);
+        ShiftLines(n->Right, delta);
+    } else if (auto n = dynamic_cast<IndexExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Left, delta);
+        ShiftLines(n->Index, delta);
+    } else if (auto n = dynamic_cast<CallExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Function, delta);
+        ShiftLines(n->Arguments, delta);
+    } else if (auto n = dynamic_cast<LetStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Name, delta);
+        ShiftLines(n->Value, delta);
+    } else if (auto n = dynamic_cast<AssignStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Name, delta);
+        ShiftLines(n->Value, delta);
+    } else if (auto n = dynamic_cast<ExpressionStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->TheExpression, delta);
+    } else if (auto n = dynamic_cast<BlockStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Statements, delta);
+    } else if (auto n = dynamic_cast<ReturnStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Value, delta);
+    } else if (auto n = dynamic_cast<YieldStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Value, delta);
+    } else if (auto n = dynamic_cast<VoiceStatement*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Voices, delta);
+    } else if (auto n = dynamic_cast<AccessExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Parent, delta);
+        ShiftLines(n->TheStatement, delta);
+    } else if (auto n = dynamic_cast<IfExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Condition, delta);
+        ShiftLines(n->Consequence, delta);
+        ShiftLines(n->Alternative, delta);
+    } else if (auto n = dynamic_cast<ForIterative*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Index, delta);
+        ShiftLines(n->Array, delta);
+    } else if (auto n = dynamic_cast<ForExpression*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Iterative, delta);
+        ShiftLines(n->Body, delta);
+    } else if (auto n = dynamic_cast<FunctionLiteral*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Ident, delta);
+        ShiftLines(n->Parameters, delta);
+        ShiftLines(n->Body, delta);
+    } else if (auto n = dynamic_cast<ArrayLiteral*>(node)) {
+        Shift(n->TheToken, delta);
+        ShiftLines(n->Elements, delta);
+    } else if (auto n = dynamic_cast<HashLiteral*>(node)) {
+        Shift(n->TheToken, delta);
+        for (const auto& [key, value] : n->Pairs) {
+            ShiftLines(key, delta);
+            ShiftLines(value, delta);
+        }
+    }
+}
+
+std::shared_ptr<AstProgram> IncrementalParser::ParseAll(const std::string& source) {
+    Lexer l(source);
+    Parser p(l, baseDir);
+    auto program = p.ParseProgram();
+    Errors = p.Errors;
+    Reused = 0;
+    Reparsed = program->Statements.size();
+    Changed = true;
+    statements.clear();
+    order.clear();
+    return program;
+}
+
+std::shared_ptr<AstProgram> IncrementalParser::Parse(const std::string& source) {
+    Errors.clear();
+    Reused = 0;
+    Reparsed = 0;
+
+    auto program = std::make_shared<AstProgram>();
+    std::unordered_map<std::string, std::vector<Span>> next;
+    std::vector<std::pair<std::string, size_t>> nextOrder;
+
+    for (const auto& span : SplitTopLevel(source)) {
+        std::string text = source.substr(span.Start, span.End - span.Start);
+        Span parsed;
+
+        // The same text can appear more than once, every copy needs
+        // statements of its own with its own line numbers. A copy that stayed
+        // on its line is taken first, as it needs no shifting.
+        auto it = statements.find(text);
+        if (it != statements.end() && !it->second.empty()) {
+            auto& copies = it->second;
+            auto same = std::find_if(copies.begin(), copies.end(), [&](const Span& copy) { return copy.Line == span.Line; });
+            if (same == copies.end()) same = copies.end() - 1;
+            parsed = std::move(*same);
+            copies.erase(same);
+
+            if (parsed.Line != span.Line) {
+                ShiftLines(parsed.Statements, (int64_t)span.Line - (int64_t)parsed.Line);
+                parsed.Line = span.Line;
+            }
+            Reused++;
+        } else {
+            Lexer l(text, span.Line);
+            Parser p(l, baseDir);
+            auto part = p.ParseProgram();
+            // A span the splitter cut in the wrong place does not parse on
+            // its own, so fall back to parsing the whole file.
+            if (!p.Errors.empty()) return ParseAll(source);
+
+            parsed = Span{part->Statements, span.Line};
+            Reparsed++;
+        }
+
+        program->Statements.insert(program->Statements.end(), parsed.Statements.begin(), parsed.Statements.end());
+        nextOrder.emplace_back(text, span.Line);
+        next[std::move(text)].push_back(std::move(parsed));
+    }
+
+    Changed = nextOrder != order;
+    statements = std::move(next);
+    order = std::move(nextOrder);
+    return program;
+}
+
+int Watch(std::string fileName) {
+    std::error_code ec;
+    auto lastWrite = std::filesystem::last_write_time(fileName, ec);
+    if (ec) {
+        std::cerr << "Error: Could not watch file '" << fileName << "' - " << ec.message() << std::endl;
+        return 1;
+    }
+
+    auto dir = std::filesystem::path(fileName).parent_path().string();
+    IncrementalParser parser(dir);
+    bool first = true;
+
+    while (true) {
+        if (!first) std::this_thread::sleep_for(WATCH_INTERVAL);
+
+        auto modifiedAt = std::filesystem::last_write_time(fileName, ec);
+        bool modulesChanged = ModuleCache::Instance().Refresh();
+        if (ec || (!first && modifiedAt == lastWrite && !modulesChanged)) continue;
+        lastWrite = modifiedAt;
+        first = false;
+
+        std::string source;
+        if (!ReadSourceFile(fileName, source)) {
+            std::cerr << "Error: Failed to read file '" << fileName << "'" << std::endl;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto program = parser.Parse(source);
+        if (!parser.Errors.empty()) {
+            for (const auto& err : parser.Errors) {
+                std::cerr << err << std::endl;
+            }
+            continue;
+        }
+        if (!parser.Changed && !modulesChanged) continue;
+
+        ModuleCache::Instance().Prefetch(program, dir);
+        Interpreter interpreter;
+        auto fin = interpreter.Run(program);
+        if (fin->Type() == ObjectType::ERROR) {
+            std::cout << fin->Inspect() << std::endl;
+        } else if (fin->Type() == ObjectType::EXIT) {
+            std::cout << "The program exited with code " << fin->Inspect() << std::endl;
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << fmt::format("[watch] {0}: reparsed {1} of {2} statements, rendered in {3:.1f} ms",
+                                 fileName, parser.Reparsed, parser.Reparsed + parser.Reused, elapsed.count())
+                  << std::endl;
+    }
+}